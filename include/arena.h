@@ -0,0 +1,17 @@
+#pragma once
+
+#include <memory_resource>
+#include <vector>
+
+// Monotonic storage of a whole scene: nothing is freed before the arena itself, which releases everything at once
+class Arena : public std::pmr::monotonic_buffer_resource {
+public:
+	Arena(size_t blockSize = 1<<20): std::pmr::monotonic_buffer_resource(blockSize) {}
+
+	template<typename T>
+	inline T* alloc(size_t n) { return static_cast<T*>(allocate(n * sizeof(T), alignof(T))); }
+};
+
+// Contiguous array living in an arena
+template<typename T>
+using Pool = std::pmr::vector<T>;
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "mesh.h"
+#include "parallel.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Registry of the images and meshes of a scene, decoded, parsed and built on a thread pool while the rest of the scene is described.
+// Files are told apart by content, so that an image or a mesh source is read once whatever the paths it is requested with.
+// finish adds the results to the scene in request order, and has to be called before building it.
+// The settings of the scene must not change while assets are loading.
+class AssetLoader {
+public:
+	AssetLoader(Scene &scene): scene(scene) {}
+
+	// Texture of the image, usable at once although the image is only set by finish
+	uint image(const std::string &fileName);
+	// OBJ or PLY file, by extension, transformed as by transformMesh
+	void mesh(const std::string &fileName, const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos, uint material);
+
+	// Waits for the jobs and adds their results, rethrowing the first error
+	void finish();
+
+private:
+	using Commit = std::function<void(Scene&)>;
+
+	// Positions and faces of a mesh file, parsed by the first instance needing them
+	struct Source {
+		std::once_flag parsed;
+		std::vector<Vec3> vertices;
+		std::vector<uint> indices;
+	};
+
+	uint64_t contentHash(const std::string &fileName);
+
+	Scene &scene;
+	std::map<std::string, uint64_t> hashes; // by canonical path
+	std::map<uint64_t, uint> images; // textures by content
+	std::map<uint64_t, std::shared_ptr<Source>> sources; // by content
+	std::vector<std::future<Commit>> commits;
+	ThreadPool pool; // destroyed first, so that the running jobs end before the rest
+};
\ No newline at end of file
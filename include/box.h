@@ -0,0 +1,86 @@
+#pragma once
+
+#include "hittable.h"
+
+// Parallelepiped spanned by the edges b-a, c-a and d-a, intersected with a single slab test.
+// The inverse of the edge matrix maps the box to the unit cube; like triangles,
+// it is stored in floats relative to the first corner.
+class Box {
+public:
+	Box(const Vec3 &a, const Vec3 &b, const Vec3 &c, const Vec3 &d, bool biface=false);
+
+	inline bool hit(const Ray &ray, Scalar tMax, Scalar &t) const {
+		const Vec3 o = ray.origin - Vec3(origin[0], origin[1], origin[2]);
+		Scalar tNear = - std::numeric_limits<Scalar>::max(), tFar = std::numeric_limits<Scalar>::max();
+		for(uint i = 0; i < 3; ++i) {
+			const float *row = rows + 3*i;
+			const Scalar invD = 1. / (row[0] * ray.direction.x + row[1] * ray.direction.y + row[2] * ray.direction.z);
+			const Scalar oi = row[0] * o.x + row[1] * o.y + row[2] * o.z;
+			Scalar t0 = - oi * invD, t1 = (1. - oi) * invD;
+			if(invD < 0.) std::swap(t0, t1);
+			tNear = std::max(tNear, t0);
+			tFar = std::min(tFar, t1);
+		}
+		if(tNear > tFar) return false;
+		t = tNear > EPS ? tNear : tFar;
+		return t > EPS && t < tMax;
+	}
+
+	AABB boundingBox() const;
+
+	inline Vec3 getNormal(const Vec3 &pos, const Ray &ray) const {
+		const Vec3 l = local(pos);
+		const uint f = face(l);
+		const float *row = rows + 3*f;
+		Vec3 normal(row[0], row[1], row[2]);
+		normal /= l[f] < .5 ? -normal.norm() : normal.norm();
+		return (flags & BIFACE) && dot(normal, ray.direction) > 0. ? -normal : normal;
+	}
+
+	inline Vec2 getUV(const Vec3 &pos, const Vec3 &) const {
+		const Vec3 l = local(pos);
+		const uint f = face(l);
+		return Vec2(l[(f+1)%3], l[(f+2)%3]);
+	}
+
+	// World area of the face at pos, mapped to the unit square of the UV
+	inline Scalar uvArea(const Vec3 &pos) const {
+		const float *row = rows + 3*face(local(pos));
+		const Scalar det = rows[0] * (Scalar(rows[4]) * rows[8] - Scalar(rows[5]) * rows[7])
+						- rows[1] * (Scalar(rows[3]) * rows[8] - Scalar(rows[5]) * rows[6])
+						+ rows[2] * (Scalar(rows[3]) * rows[7] - Scalar(rows[4]) * rows[6]);
+		return Vec3(row[0], row[1], row[2]).norm() / std::abs(det);
+	}
+
+private:
+	enum Flags : u_char { BIFACE = 1 };
+
+	// Coordinates of a point in the unit cube frame
+	inline Vec3 local(const Vec3 &pos) const {
+		const Vec3 p = pos - Vec3(origin[0], origin[1], origin[2]);
+		return Vec3(rows[0] * p.x + rows[1] * p.y + rows[2] * p.z,
+					rows[3] * p.x + rows[4] * p.y + rows[5] * p.z,
+					rows[6] * p.x + rows[7] * p.y + rows[8] * p.z);
+	}
+
+	// Index of the slab whose face is the closest to the point
+	inline uint face(const Vec3 &l) const {
+		uint f = 0;
+		Scalar best = std::numeric_limits<Scalar>::max();
+		for(uint i = 0; i < 3; ++i) {
+			const float *row = rows + 3*i;
+			const Scalar dist = std::min(std::abs(l[i]), std::abs(1. - l[i])) / Vec3(row[0], row[1], row[2]).norm();
+			if(dist < best) {
+				best = dist;
+				f = i;
+			}
+		}
+		return f;
+	}
+
+	float origin[3];
+	float rows[9]; // inverse of the edge matrix
+	u_char flags;
+};
+
+void addBoxRotY(Scene &scene, const Vec3 &size, const Vec3 &pos, Scalar angle, uint material, bool biface=false);
\ No newline at end of file
@@ -1,31 +1,144 @@
 #pragma once
 
 #include "hittable.h"
+#include "arena.h"
+#include "stats.h"
 
-class BVHNode : public Hittable {
-public:
-	BVHNode(HittableList &list): BVHNode(list.begin(), list.size()) {}
-	BVHNode(std::vector<std::shared_ptr<const Hittable>>::iterator start, size_t nb);
-
-	bool hit(const Ray &ray, Scalar tMax, HitRecord &record) const override;
+struct BVHPrimitive {
+	AABB box;
+	PrimitiveRef ref;
+};
 
-	inline bool isNode() const override { return true; }
+struct BVHNode {
+	AABB box;
+	uint index; // first primitive of a leaf, right child of an inner node (the left one is next)
+	u_char count; // 0 for inner nodes
+	PrimitiveType type;
 
-	inline Vec3 getNormal(const Vec3 &, const Ray &) const override { return Vec3(); }
+	inline bool isLeaf() const { return count > 0; }
+};
 
-private:
-	std::shared_ptr<const Hittable> left, right;
-	friend class BVHTree;
+// Nodes of a prebuilt BVH whose leaves index primitives from offset
+struct BVHSubtree {
+	const BVHNode *nodes;
+	size_t nbNodes;
+	uint offset;
 };
 
-class BVHTree : public Hittable {
+class BVH {
 public:
-	BVHTree(HittableList &list): root(std::make_shared<BVHNode>(list)) { box = root->boundingBox(); }
+	BVH(Arena &arena): nodes(&arena) {}
+
+	// Reorders primitives so that each leaf covers a contiguous range of primitives of the same type.
+	// Meshes get a leaf of their own.
+	void build(std::vector<BVHPrimitive> &primitives);
+
+	// Replaces the mesh leaves by the subtree given for their mesh
+	template<typename GetSubtree>
+	void graft(const GetSubtree &getSubtree);
+
+	template<typename LeafHit>
+	inline bool hit(const Ray &ray, Scalar tMax, HitRecord &record, const LeafHit &hitLeaf) const {
+		return hit(nodes.data(), ray, tMax, record, hitLeaf);
+	}
 
-	bool hit(const Ray &ray, Scalar tMax, HitRecord &record) const override;
+	// Traversal of any flat node array laid out by build
+	template<typename LeafHit>
+	static bool hit(const BVHNode *nodes, const Ray &ray, Scalar tMax, HitRecord &record, const LeafHit &hitLeaf);
 
-	inline Vec3 getNormal(const Vec3 &, const Ray &) const override { return Vec3(); }
+	inline bool empty() const { return nodes.empty(); }
+	inline Pool<BVHNode>::iterator begin() { return nodes.begin(); }
+	inline Pool<BVHNode>::iterator end() { return nodes.end(); }
+	inline size_t size() const { return nodes.size(); }
+	inline const BVHNode* data() const { return nodes.data(); }
+
+	static int depth(const BVHNode *nodes, uint n = 0);
+	// Whether nodes read from a file are laid out as by build, no deeper than MaxDepth, with leaves within nbPrimitives
+	// primitives, and of triangles unless only their ranges matter
+	static bool valid(const BVHNode *nodes, size_t nbNodes, size_t nbPrimitives, bool triangleLeaves=true);
+
+	static constexpr size_t MaxLeafSize = 4;
+	static constexpr int MaxDepth = 128;
 
 private:
-	std::shared_ptr<const BVHNode> root;
-};
\ No newline at end of file
+	int build(std::vector<BVHPrimitive>::iterator start, size_t nb, size_t offset, Scalar *surfaces);
+	int addLeaf(std::vector<BVHPrimitive>::iterator start, size_t nb, size_t offset);
+
+	template<typename GetSubtree>
+	int graft(std::vector<BVHNode> &grafted, uint n, const GetSubtree &getSubtree) const;
+
+	Pool<BVHNode> nodes;
+};
+
+template<typename GetSubtree>
+void BVH::graft(const GetSubtree &getSubtree) {
+	if(nodes.empty()) return;
+	std::vector<BVHNode> grafted;
+	grafted.reserve(nodes.size());
+	if(graft(grafted, 0, getSubtree) > MaxDepth) throw std::runtime_error("BVH is too deep!");
+	nodes.assign(grafted.begin(), grafted.end());
+}
+
+template<typename GetSubtree>
+int BVH::graft(std::vector<BVHNode> &grafted, uint n, const GetSubtree &getSubtree) const {
+	const BVHNode &node = nodes[n];
+	if(node.isLeaf() && node.type == MESH) {
+		const BVHSubtree subtree = getSubtree(node.index);
+		const uint base = grafted.size();
+		for(size_t i = 0; i < subtree.nbNodes; ++i) {
+			BVHNode &copy = grafted.emplace_back(subtree.nodes[i]);
+			copy.index += copy.isLeaf() ? subtree.offset : base;
+		}
+		return depth(subtree.nodes);
+	}
+	const uint id = grafted.size();
+	grafted.push_back(node);
+	if(node.isLeaf()) return 1;
+	const int depth = graft(grafted, n+1, getSubtree);
+	grafted[id].index = grafted.size();
+	return 1 + std::max(depth, graft(grafted, node.index, getSubtree));
+}
+
+template<typename LeafHit>
+bool BVH::hit(const BVHNode *nodes, const Ray &ray, Scalar tMax, HitRecord &record, const LeafHit &hitLeaf) {
+	const Ray rayInv(ray.origin, 1. / ray.direction);
+	std::pair<uint, Scalar> stack[MaxDepth];
+	int stackSize = 0;
+	bool anyHit = false;
+	uint n = 0;
+	while(true) {
+		const BVHNode &node = nodes[n];
+		if(node.isLeaf()) {
+			if(hitLeaf(node, ray, tMax, record)) {
+				anyHit = true;
+				tMax = record.t;
+			}
+		} else {
+			UPDATE_NODE_STATS
+			Scalar tLeft, tRight;
+			const bool hitLeft = nodes[n+1].box.hitInv(rayInv, tMax, tLeft);
+			const bool hitRight = nodes[node.index].box.hitInv(rayInv, tMax, tRight);
+			if(hitLeft && hitRight) {
+				if(tLeft < tRight) {
+					stack[stackSize++] = { node.index, tRight };
+					++ n;
+				} else {
+					stack[stackSize++] = { n+1, tLeft };
+					n = node.index;
+				}
+				continue;
+			} else if(hitLeft) {
+				++ n;
+				continue;
+			} else if(hitRight) {
+				n = node.index;
+				continue;
+			}
+		}
+		// Pop the nearest postponed node which can still be hit
+		do {
+			if(stackSize == 0) return anyHit;
+		} while(stack[--stackSize].second >= tMax);
+		n = stack[stackSize].first;
+	}
+}
\ No newline at end of file
@@ -1,14 +1,28 @@
-#include "vec.h"
+#include "sampler.h"
 
 class Camera {
 public:
 	Camera() = default;
 	Camera(const Vec3 &pos, const Vec3 &direction, const Vec3 &up, Scalar fov, Scalar aspectRatio, Scalar aperture, Scalar focusDistance);
 
-	Ray getRay(Scalar x, Scalar y) const;
+	Ray getRay(Scalar x, Scalar y, Sampler &sampler) const;
+	// Rays then get the spread of a pixel
+	inline void setResolution(int imgWidth) { pixelSpread = viewWidth / imgWidth; }
+
+	inline const Vec3& position() const { return pos; }
+	// Pixels covered by the disk a sphere projects to, infinite when the camera is inside it
+	inline Scalar projectedArea(const Vec3 &center, Scalar radius, int imgWidth) const {
+		const Scalar distance2 = (center - pos).norm2(), radius2 = radius * radius;
+		if(distance2 <= radius2) return std::numeric_limits<Scalar>::infinity();
+		// Tangent of the half angle of the cone tangent to the sphere, in pixels
+		const Scalar pixelRadius = radius / std::sqrt(distance2 - radius2) * imgWidth / viewWidth;
+		return M_PI * pixelRadius * pixelRadius;
+	}
 
 private:
 	Vec3 pos, corner, horizontal, vertical;
 	Vec3 u, v;
 	Scalar lensRadius;
+	Scalar viewWidth; // at unit distance
+	Scalar pixelSpread = 0.;
 };
\ No newline at end of file
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "bvh.h"
+#include "arena.h"
+
+// Mesh stored quantized: 16-bit positions relative to its bounds, octahedral normals and delta-coded indices.
+// Triangles are only decoded in the BVH leaves reached by a ray, trading some arithmetic for memory.
+
+struct CompressedTriangle {
+	uint32_t v0; // first vertex, or first escaped index
+	int16_t d1, d2; // other vertices relative to v0, d1 is Escape when they do not fit
+	uint16_t normal[2]; // octahedral
+
+	static constexpr int16_t Escape = -32768;
+};
+
+class CompressedMesh {
+public:
+	// Faces are given in the order of the leaves of the mesh BVH
+	CompressedMesh(const Vec3 *positions, size_t nbPositions, const uint *indices, size_t nbTriangles,
+					const BVHNode *nodes, size_t nbNodes, uint material, Arena &arena);
+
+	// Sets the element of the record on a hit
+	bool hit(const Ray &ray, Scalar tMax, HitRecord &record) const;
+
+	inline const AABB& boundingBox() const { return nodes[0].box; }
+	Vec3 getNormal(uint triangle) const;
+	Vec2 getUV(uint triangle, const Vec3 &pos) const;
+	Scalar uvArea(uint triangle) const;
+
+	inline uint getMaterial() const { return material; }
+
+	// Bytes used, and that the same mesh would use as triangles
+	size_t size() const;
+	size_t uncompressedSize() const;
+
+private:
+	inline Vec3 vertex(uint i) const {
+		const uint16_t *q = vertices + 3*i;
+		return Vec3(lo.x + q[0] * step.x, lo.y + q[1] * step.y, lo.z + q[2] * step.z);
+	}
+
+	inline void decode(uint triangle, Vec3 &a, Vec3 &b, Vec3 &c) const {
+		const CompressedTriangle &tri = triangles[triangle];
+		if(tri.d1 == CompressedTriangle::Escape) {
+			const uint *ids = escapes + tri.v0;
+			a = vertex(ids[0]);
+			b = vertex(ids[1]);
+			c = vertex(ids[2]);
+		} else {
+			a = vertex(tri.v0);
+			b = vertex(tri.v0 + tri.d1);
+			c = vertex(tri.v0 + tri.d2);
+		}
+	}
+
+	BVHNode *nodes;
+	size_t nbNodes;
+	uint16_t *vertices;
+	size_t nbVertices;
+	CompressedTriangle *triangles;
+	size_t nbTriangles;
+	uint *escapes;
+	size_t nbEscapes;
+	Vec3 lo, step;
+	uint material;
+};
\ No newline at end of file
@@ -4,54 +4,31 @@
 #include "aabb.h"
 #include <vector>
 
-class Hittable;
-struct HitRecord {
-	const Hittable *hittable;
-	Scalar t;
-	Vec3 normal;
+// Tag of a primitive, used to select the array it lives in and the intersection routine
+enum PrimitiveType : u_char {
+	SPHERE,
+	TRIANGLE_X, TRIANGLE_Y, TRIANGLE_Z, // by dominant axis of the normal
+	QUAD_X, QUAD_Y, QUAD_Z,
+	RECT_X, RECT_Y, RECT_Z, // by axis of the normal
+	BOX,
+	MEDIUM,
+	MESH, // prebuilt BVH over triangles, grafted in the scene one
+	STREAMED, // mesh paged in from disk by chunks
+	LOD, // mesh with simplified levels, traversed at the selected one
+	COMPRESSED // quantized mesh decoded in its leaves
 };
 
-class Hittable {
-public:
-	virtual ~Hittable() {}
-
-	virtual bool hit(const Ray &ray, Scalar tMax, HitRecord &record) const = 0;
-	
-	bool hitBox(const Ray &ray, Scalar tMax, Scalar &t) const { return box.hit(ray, tMax, t); }
-	bool hitBoxInv(const Ray &ray, Scalar tMax, Scalar &t) const { return box.hitInv(ray, tMax, t); }
-	const AABB& boundingBox() const { return box; }
-
-	inline virtual bool scatter(UNUSUED const Ray &ray, UNUSUED const HitRecord &record, ScatterRecord &out) const {
-		out.emitted.zero();
-		return false;
-	}
-	inline virtual Scalar scattering_pdf(UNUSUED const Vec3 &normal, UNUSUED const Ray &ray) const { return 0.; }
-
-	virtual Vec3 getNormal(const Vec3 &pos, const Ray &ray) const = 0;
-
-	inline virtual Vec2 getUV(const Vec3 &, const Vec3 &) const { return Vec2(0., 0.); }
-
-	inline virtual bool isNode() const { return false; }
-
-protected:
-	AABB box;
+struct PrimitiveRef {
+	PrimitiveType type;
+	uint index;
 };
 
-class HittableList : public Hittable {
-public:
-	~HittableList() {}
-
-	bool hit(const Ray &ray, Scalar tMax, HitRecord &record) const override;
-
-	void add(const Hittable *object);
-	void add(std::shared_ptr<Hittable> object);
-
-	inline std::vector<std::shared_ptr<const Hittable>>::iterator begin() { return objects.begin(); }
-	inline std::vector<std::shared_ptr<const Hittable>>::iterator end() { return objects.end(); }
-	inline size_t size() const { return objects.size(); }
-
-	inline Vec3 getNormal(const Vec3 &, const Ray &) const override { return Vec3(); }
-
-private:
-	std::vector<std::shared_ptr<const Hittable>> objects;
+class Scene;
+struct HitRecord {
+	const Scene *scene;
+	PrimitiveRef primitive;
+	Scalar t;
+	Vec3 normal;
+	uint chunk, element; // triangle of a streamed or compressed mesh
+	Scalar footprint; // width of the ray cone on the surface
 };
\ No newline at end of file
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "hittable.h"
+
+enum LightType : u_char { SPHERE_LIGHT, TRIANGLE_LIGHT, QUAD_LIGHT };
+
+// Plain emitter record, sampled by a switch on its type: a sphere of center p,
+// or a triangle or parallelogram spanned by e1 and e2 from p
+struct Light {
+	LightType type;
+	bool biface;
+	Vec3 p, e1, e2, normal;
+	Scalar radius, area, power;
+
+	static Light sphere(const Vec3 &center, Scalar radius, Scalar emitted);
+	static Light planar(LightType type, const Vec3 &a, const Vec3 &b, const Vec3 &c, bool biface, Scalar emitted);
+
+	AABB boundingBox() const;
+
+	// Direction from the origin of the ray towards a point of the light, from a point of the unit square.
+	// Returns its solid angle pdf, 0 when the origin sees nothing of the light.
+	Scalar generate(Ray &ray, const Vec2 &u) const;
+	// Solid angle pdf of the direction of the ray, 0 when it misses the light
+	Scalar value(const Ray &ray) const;
+};
+
+// Bounds of the lights below a node: position, total power and cone of their normals
+struct LightNode {
+	AABB box;
+	Vec3 axis;
+	Scalar cosTheta, sinTheta; // of the half angle of the cone, cosTheta being -1 when they emit in all directions
+	Scalar power;
+	uint index; // light of a leaf, right child of an inner node (the left one is next)
+	bool leaf;
+
+	// Upper bound of the light received at p, on a surface of the given normal (null in media)
+	Scalar importance(const Vec3 &p, const Vec3 &normal) const;
+};
+
+// BVH over the emitters, whose nodes bound the position, the power and the orientation of their lights.
+// A shading point picks a light in O(log n) by descending the tree, choosing each child by its importance
+// (Conty Estevez and Kulla 2018). The pdf of a direction only descends into the nodes the ray crosses.
+class LightBVH {
+public:
+	inline void add(const Light &light) { if(light.power > 0.) lights.push_back(light); }
+	// Binned split minimizing the surface area orientation heuristic
+	void build();
+
+	inline bool empty() const { return lights.empty(); }
+	inline size_t size() const { return lights.size(); }
+
+	// Direction from the origin of the ray towards a light, both picked from the point of the unit square.
+	// Returns its pdf, 0 when no light reaches the point.
+	Scalar generate(const Vec3 &normal, Ray &ray, Vec2 u) const;
+	// Pdf of the direction of the ray, summed over the lights it crosses
+	Scalar value(const Vec3 &normal, const Ray &ray) const;
+
+private:
+	uint build(std::vector<LightNode> &leaves, uint start, uint end, int depth);
+
+	std::vector<Light> lights;
+	std::vector<LightNode> nodes;
+};
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+	MappedFile(const std::string &fileName);
+	~MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile& operator=(const MappedFile &) = delete;
+
+	inline const char* begin() const { return data; }
+	inline const char* end() const { return data + length; }
+	inline size_t size() const { return length; }
+
+	// FNV-1a of fixed size blocks, hashed in parallel, then of the block hashes
+	uint64_t hash() const;
+
+private:
+	const char *data = nullptr;
+	size_t length = 0;
+};
\ No newline at end of file
@@ -2,8 +2,7 @@
 
 #include "texture.h"
 #include "pdf.h"
-
-#include <memory>
+#include "sampler.h"
 
 struct HitRecord;
 
@@ -15,61 +14,28 @@ struct ScatterRecord {
 	const PDF *pdf;
 };
 
-class Material {
-public:
-	virtual ~Material() {}
-
-	virtual bool scatter(const Ray &ray, const HitRecord &record, ScatterRecord &out) const = 0;
-	inline virtual Scalar scattering_pdf(UNUSUED const Vec3 &normal, UNUSUED const Ray &ray) const { return 0.; }
-};
-
-class Lambertian : public Material {
-public:
-	Lambertian(const Color &albedo): albedo(std::make_shared<SolidColor>(albedo)) {}
-	Lambertian(std::shared_ptr<Texture> albedo): albedo(std::move(albedo)) {}
-
-	bool scatter(const Ray &ray, const HitRecord &record, ScatterRecord &out) const override;
-	inline Scalar scattering_pdf(const Vec3 &normal, const Ray &ray) const override {
-		return pdf->value(normal, ray);
+enum MaterialType : u_char { LAMBERTIAN, METAL, DIELECTRIC, DIFFUSE_LIGHT, ISOTROPIC };
+
+// Plain material record, shaded by a single switch on its type
+struct Material {
+	MaterialType type;
+	uint texture; // albedo of lambertians, emission of lights
+	Color albedo; // metals and media
+	Scalar param; // fuzz of metals, refractive index of dielectrics
+
+	static Material lambertian(uint albedo) { return { LAMBERTIAN, albedo, Color(), 0. }; }
+	static Material metal(const Color &albedo, Scalar fuzz) { return { METAL, 0, albedo, fuzz }; }
+	static Material dielectric(Scalar reflectiveIndex) { return { DIELECTRIC, 0, Color(), reflectiveIndex }; }
+	static Material diffuseLight(uint emit) { return { DIFFUSE_LIGHT, emit, Color(), 0. }; }
+	static Material isotropic(const Color &albedo) { return { ISOTROPIC, 0, albedo, 0. }; }
+
+	bool scatter(const Ray &ray, const HitRecord &record, ScatterRecord &out, Sampler &sampler) const;
+
+	inline Scalar scattering_pdf(const Vec3 &normal, const Ray &ray) const {
+		switch(type) {
+		case LAMBERTIAN: return PDF::lambertian.value(normal, ray);
+		case ISOTROPIC: return PDF::uniformVal;
+		default: return 0.;
+		}
 	}
-
-private:
-	static const PDF *pdf;
-	std::shared_ptr<Texture> albedo;
-};
-
-class Metal : public Material {
-public:
-	Metal(const Color &albedo, Scalar fuzz): albedo(albedo), fuzz(fuzz) {}
-	~Metal() {}
-
-	bool scatter(const Ray &ray, const HitRecord &record, ScatterRecord &out) const override;
-
-private:
-	Color albedo;
-	Scalar fuzz;
-};
-
-class Dielectric : public Material {
-public:
-	Dielectric(Scalar reflectiveIndex): reflectiveIndex(reflectiveIndex) {}
-	~Dielectric() {}
-
-	bool scatter(const Ray &ray, const HitRecord &record, ScatterRecord &out) const override;
-
-private:
-	Scalar reflectiveIndex;
-};
-
-
-class DiffuseLight : public Material {
-public:
-	DiffuseLight(const Color &emit): emit(std::make_shared<SolidColor>(emit)) {}
-	DiffuseLight(Texture *emit): emit(emit) {}
-	DiffuseLight(std::shared_ptr<Texture> emit): emit(emit) {}
-
-	bool scatter(const Ray &ray, const HitRecord &record, ScatterRecord &out) const override;
-
-private:
-	std::shared_ptr<Texture> emit;
 };
\ No newline at end of file
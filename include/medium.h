@@ -2,26 +2,26 @@
 
 #include "hittable.h"
 
-class ConstantMedium : public Hittable {
+class ConstantMedium {
 public:
-	ConstantMedium(std::shared_ptr<Hittable> b, Scalar density, const Color color):
-		boundary(std::move(b)),
+	ConstantMedium(PrimitiveRef boundary, const AABB &box, Scalar density, uint material):
+		boundary(boundary),
+		box(box),
 		negInvDensity(-1./density),
-		color(color) {
-		box = boundary->boundingBox();
-	}
+		material(material) {}
 	
-	bool hit(const Ray &ray, Scalar tMax, HitRecord &record) const override;
-	bool scatter(const Ray &ray, const HitRecord &record, ScatterRecord &out) const override;
-	inline virtual Scalar scattering_pdf(UNUSUED const Vec3 &normal, const Ray &ray) const override {
-		return UniformPDF::instance->value(normal, ray);
-	}
+	bool hit(const Scene &scene, const Ray &ray, Scalar tMax, Scalar &t) const;
 
-	inline Vec3 getNormal(const Vec3 &, const Ray &) const override { return Vec3::randomSphere(); }
+	inline const AABB& boundingBox() const { return box; }
+
+	inline Vec3 getNormal(const Vec3 &, const Ray &) const { return Vec3::randomSphere(); }
+
+	inline uint getMaterial() const { return material; }
 
 private:
-	static const PDF *pdf;
-	std::shared_ptr<const Hittable> boundary;
+	friend class Scene;
+	PrimitiveRef boundary;
+	AABB box;
 	Scalar negInvDensity;
-	Color color;
+	uint material;
 };
\ No newline at end of file
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "bvh.h"
+#include "triangle.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class Scene;
+class MappedFile;
+
+// Triangles with their own BVH, built or loaded from the cache once and grafted in the scene BVH
+struct Mesh {
+	uint firstTriangle, nbTriangles;
+	const BVHNode *nodes;
+	size_t nbNodes;
+};
+
+constexpr uint MaxLODLevels = 8;
+
+struct LODLevel {
+	uint firstTriangle, nbTriangles;
+	const BVHNode *nodes;
+};
+
+// Levels of a mesh, each with about half the triangles of the previous one; a single level is traced per frame
+struct LODMesh {
+	LODLevel levels[MaxLODLevels];
+	uint nbLevels, level;
+};
+
+// Fits the mesh in the unit box, rotates it by angle (in degrees) around rotAxis, then scales and moves it to pos
+void transformMesh(std::vector<Vec3> &vertices, const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos);
+
+// Meshes are loaded and built without touching the scene, which is only read for its settings, so that they can be loaded concurrently.
+// What is left is a commit, adding the mesh to the scene, which holds the data it needs.
+using MeshCommit = std::function<void(Scene&)>;
+// Fills the positions and faces of a mesh file
+using MeshParser = void (*)(const std::string &fileName, const MappedFile &file, std::vector<Vec3> &vertices, std::vector<uint> &indices);
+using MeshSource = std::function<void(std::vector<Vec3> &vertices, std::vector<uint> &indices)>;
+
+// Path of a file derived from fileName and key, in the cache directory next to fileName, which can be cleared at any time
+std::string cachePath(const std::string &fileName, uint64_t key, const std::string &extension);
+// Creates the directory of a cache path, returning false if it cannot
+bool createCacheDirectory(const std::string &path);
+// Hash of the content of a source file and of the transform applied to it
+uint64_t meshKey(uint64_t contentHash, const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos);
+// Commit of the mesh cached for fileName if it was built with the same key, from its chunk file when streaming; empty otherwise
+MeshCommit loadMeshCache(const std::string &fileName, uint64_t key, const Scene &scene, uint material);
+// Builds the non degenerated triangles of an indexed mesh, with their BVH and levels of detail, and caches them for fileName.
+// When the scene is streaming, the cache is a chunk file the mesh is then streamed from.
+MeshCommit buildMesh(const Scene &scene, std::vector<Vec3> vertices, std::vector<uint> indices, uint material, const std::string &fileName, uint64_t key);
+// From the cache, or else from the source, transformed
+MeshCommit prepareMesh(const std::string &fileName, uint64_t key, const Scene &scene, const MeshSource &source,
+						const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos, uint material);
+// Quadric edge collapses, returning the faces of nbLevels-1 levels, the l-th with at most a 2^l-th of the faces.
+// The new vertices are appended, so all the levels index the same array.
+std::vector<std::vector<uint>> simplifyMesh(std::vector<Vec3> &vertices, const std::vector<uint> &indices, uint nbLevels);
+
+// Triangulates polygonal faces; normals and texture coordinates are accepted but not used
+void parseOBJ(const std::string &fileName, const MappedFile &file, std::vector<Vec3> &vertices, std::vector<uint> &indices);
+// ASCII or binary; only vertex positions and face indices are read
+void parsePLY(const std::string &fileName, const MappedFile &file, std::vector<Vec3> &vertices, std::vector<uint> &indices);
+// Loads and adds a mesh at once
+void loadMesh(const std::string &fileName, Scene &scene, MeshParser parse, const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos, uint material);
+inline void loadOBJ(const std::string &fileName, Scene &scene, const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos, uint material) {
+	loadMesh(fileName, scene, parseOBJ, rotAxis, angle, scale, pos, material);
+}
+inline void loadPLY(const std::string &fileName, Scene &scene, const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos, uint material) {
+	loadMesh(fileName, scene, parsePLY, rotAxis, angle, scale, pos, material);
+}
\ No newline at end of file
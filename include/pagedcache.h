@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Resident pages of files, within a memory budget, for the streamed meshes and the paged textures.
+// An entry locates a page in its file, read fills the page of an entry and returns its size in bytes.
+// A miss loads the page synchronously and evicts pages by second chance: a hand sweeps the resident pages,
+// sparing once those used since it last passed, so that eviction takes constant amortized time and hits take no lock.
+// Pages are shared pointers so that an evicted page stays valid for the threads still using it.
+template<typename Entry, typename Page, size_t (*read)(int fd, const Entry &entry, Page &page)>
+class PagedCache {
+public:
+	PagedCache(size_t budget): budget(budget) {}
+	~PagedCache() {
+		for(int fd : files) close(fd);
+	}
+
+	// Registers the pages of a file and returns the id of the first one
+	uint addFile(const std::string &fileName, const std::vector<Entry> &entries);
+
+	inline std::shared_ptr<const Page> acquire(uint id) {
+		Slot &slot = slots[id];
+		std::shared_ptr<const Page> page = std::atomic_load(&slot.page);
+		if(!page) return load(id);
+		touch(slot);
+		return page;
+	}
+	// Marks a page held elsewhere as used
+	inline void touch(uint id) { touch(slots[id]); }
+
+	inline size_t residentSize() const { return resident; }
+
+private:
+	struct Slot {
+		int fd;
+		Entry entry;
+		std::shared_ptr<const Page> page;
+		size_t size;
+		std::atomic<bool> used;
+	};
+
+	inline void touch(Slot &slot) {
+		if(!slot.used.load(std::memory_order_relaxed)) slot.used.store(true, std::memory_order_relaxed);
+	}
+	std::shared_ptr<const Page> load(uint id);
+
+	size_t budget;
+	std::atomic<size_t> resident = {0};
+	std::deque<Slot> slots; // stable addresses while pages are added
+	std::vector<uint> residentIds;
+	size_t hand = 0; // in residentIds
+	std::vector<int> files;
+	std::mutex mutex;
+};
+
+template<typename Entry, typename Page, size_t (*read)(int, const Entry&, Page&)>
+uint PagedCache<Entry, Page, read>::addFile(const std::string &fileName, const std::vector<Entry> &entries) {
+	// Files may be added concurrently
+	const std::lock_guard<std::mutex> lock(mutex);
+	const int fd = open(fileName.c_str(), O_RDONLY);
+	if(fd < 0) throw std::runtime_error("Cannot open " + fileName + "!");
+	files.push_back(fd);
+	const uint first = slots.size();
+	for(const Entry &entry : entries) {
+		Slot &slot = slots.emplace_back();
+		slot.fd = fd;
+		slot.entry = entry;
+		slot.size = 0;
+		slot.used = false;
+	}
+	return first;
+}
+
+template<typename Entry, typename Page, size_t (*read)(int, const Entry&, Page&)>
+std::shared_ptr<const Page> PagedCache<Entry, Page, read>::load(uint id) {
+	const std::lock_guard<std::mutex> lock(mutex);
+	Slot &slot = slots[id];
+	// Another thread may have loaded it while we were waiting
+	if(std::shared_ptr<const Page> page = std::atomic_load(&slot.page)) return page;
+
+	const std::shared_ptr<Page> page = std::make_shared<Page>();
+	slot.size = read(slot.fd, slot.entry, *page);
+
+	while(resident + slot.size > budget && !residentIds.empty()) {
+		if(hand >= residentIds.size()) hand = 0;
+		Slot &candidate = slots[residentIds[hand]];
+		if(candidate.used.exchange(false, std::memory_order_relaxed)) {
+			++ hand;
+			continue;
+		}
+		std::atomic_store(&candidate.page, std::shared_ptr<const Page>());
+		resident -= candidate.size;
+		residentIds[hand] = residentIds.back();
+		residentIds.pop_back();
+	}
+	resident += slot.size;
+	residentIds.push_back(id);
+	slot.used = true;
+	std::atomic_store(&slot.page, std::shared_ptr<const Page>(page));
+	return page;
+}
\ No newline at end of file
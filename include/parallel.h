@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+inline uint threadCount() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+// Splits [0, n) in one contiguous range per thread and calls f(thread, begin, end) on each.
+// The calling thread takes the last range; the first exception thrown is rethrown after the join.
+template<typename F>
+void parallelFor(size_t n, const F &f) {
+	const uint T = threadCount();
+	std::vector<std::exception_ptr> errors(T);
+	const auto run = [&](uint t) {
+		try { f(t, t * n / T, (t+1) * n / T); }
+		catch(...) { errors[t] = std::current_exception(); }
+	};
+	std::vector<std::thread> threads;
+	threads.reserve(T-1);
+	for(uint t = 0; t+1 < T; ++t) threads.emplace_back(run, t);
+	run(T-1);
+	for(std::thread &thread : threads) thread.join();
+	for(const std::exception_ptr &error : errors)
+		if(error) std::rethrow_exception(error);
+}
+
+// Threads taking jobs in submission order, so that a job may wait for the result of an earlier one.
+// The queued jobs are still run by the destructor.
+class ThreadPool {
+public:
+	ThreadPool(uint nbThreads = threadCount()) {
+		for(uint t = 0; t < nbThreads; ++t) threads.emplace_back([this]() { work(); });
+	}
+
+	~ThreadPool() {
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		ready.notify_all();
+		for(std::thread &thread : threads) thread.join();
+	}
+
+	// The exception thrown by the job, if any, is rethrown by the future
+	template<typename F>
+	std::future<std::invoke_result_t<F>> submit(F &&f) {
+		const auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>(std::forward<F>(f));
+		{
+			const std::lock_guard<std::mutex> lock(mutex);
+			jobs.emplace_back([task]() { (*task)(); });
+		}
+		ready.notify_one();
+		return task->get_future();
+	}
+
+private:
+	void work() {
+		while(true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				ready.wait(lock, [this]() { return stopping || !jobs.empty(); });
+				if(jobs.empty()) return;
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+
+	std::vector<std::thread> threads;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable ready;
+	bool stopping = false;
+};
\ No newline at end of file
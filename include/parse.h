@@ -0,0 +1,67 @@
+#pragma once
+
+#include "all.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+// Hand-written text scanning over a [p, end) buffer, without locale nor null terminator
+
+inline bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline void skipBlanks(const char *&p, const char *end) {
+	while(p < end && isBlank(*p)) ++ p;
+}
+
+inline void skipLine(const char *&p, const char *end) {
+	while(p < end && *p != '\n') ++ p;
+	if(p < end) ++ p;
+}
+
+// Exact for up to 19 significant digits and small exponents, which covers usual mesh files
+inline Scalar parseScalar(const char *&p, const char *end) {
+	static constexpr Scalar pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+										1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	skipBlanks(p, end);
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+')) negative = *(p++) == '-';
+	unsigned long long mantissa = 0;
+	int exponent = 0, digits = 0;
+	const char *start = p;
+	for(; p < end && *p >= '0' && *p <= '9'; ++p, ++digits) {
+		if(digits < 19) mantissa = 10 * mantissa + (*p - '0');
+		else ++ exponent;
+	}
+	if(p < end && *p == '.') {
+		for(++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits)
+			if(digits < 19) {
+				mantissa = 10 * mantissa + (*p - '0');
+				-- exponent;
+			}
+	}
+	if(p == start || (p == start+1 && *start == '.')) throw std::runtime_error("Malformed number!");
+	if(p < end && (*p == 'e' || *p == 'E')) {
+		++ p;
+		bool negExp = false;
+		if(p < end && (*p == '-' || *p == '+')) negExp = *(p++) == '-';
+		if(p == end || *p < '0' || *p > '9') throw std::runtime_error("Malformed number!");
+		int e = 0;
+		for(; p < end && *p >= '0' && *p <= '9'; ++p) e = std::min(10 * e + (*p - '0'), 100000);
+		exponent += negExp ? -e : e;
+	}
+	Scalar value = mantissa;
+	if(exponent >= 0) value *= exponent <= 22 ? pow10[exponent] : std::pow(10., exponent);
+	else value /= exponent >= -22 ? pow10[-exponent] : std::pow(10., -exponent);
+	return negative ? -value : value;
+}
+
+inline long parseInteger(const char *&p, const char *end) {
+	skipBlanks(p, end);
+	bool negative = false;
+	if(p < end && (*p == '-' || *p == '+')) negative = *(p++) == '-';
+	if(p == end || *p < '0' || *p > '9') throw std::runtime_error("Malformed integer!");
+	long i = 0;
+	for(; p < end && *p >= '0' && *p <= '9'; ++p) i = 10 * i + (*p - '0');
+	return negative ? -i : i;
+}
\ No newline at end of file
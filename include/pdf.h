@@ -2,82 +2,58 @@
 
 #include "vec.h"
 
-class PDF {
-public:
-	virtual ~PDF() {}
-
-	virtual Scalar value(const Vec3 &normal, const Ray &ray) const = 0;
-	virtual Scalar generate(const Vec3 &normal, Ray &ray) const = 0;
-};
+enum PDFType : u_char { UNIFORM, COSINE, CONE, TARGET_COSINE, TARGET_CONE };
 
-class UniformPDF : public PDF {
-public:
-	UniformPDF() {}
+inline Scalar cosineValue(Scalar power, const Vec3 &dir, const Ray &ray) {
+	const Scalar cosTheta = dot(dir, ray.direction);
+	return cosTheta <= 0. ? 0. : std::pow(cosTheta, power) * (power + 1.) * (.5 * (1. / M_PI));
+}
 
-	inline Scalar value(UNUSUED const Vec3 &normal, UNUSUED const Ray &ray) const override {
-		return pdf_val;
-	}
+inline Scalar coneValue(Scalar cosMax, const Vec3 &dir, const Ray &ray) {
+	const Scalar cosTheta = dot(dir, ray.direction);
+	return cosTheta < cosMax ? 0. : 1. / (2. * M_PI * (1. - cosMax));
+}
 
-	inline Scalar generate(UNUSUED const Vec3 &normal, Ray &ray) const override {
-		ray.direction = Vec3::randomSphere();
-		return pdf_val;
-	}
+// Directions from a point of the unit square
+Scalar cosineGenerate(Scalar power, const Vec3 &dir, Ray &ray, const Vec2 &u);
+Scalar coneGenerate(Scalar cosMax, const Vec3 &dir, Ray &ray, const Vec2 &u);
 
-	static const PDF *instance;
-	static constexpr Scalar pdf_val = 1. / (4. * M_PI);
-};
-
-class CosinePDF : public PDF {
-public:
-	CosinePDF(Scalar power): power(power) {}
-
-	inline Scalar value(const Vec3 &normal, const Ray &ray) const override {
-		const Scalar cosTheta = dot(normal, ray.direction);
-		return cosTheta <= 0. ? 0. : std::pow(cosTheta, power) * (power + 1.) * (.5 * (1. / M_PI));
-	}
-
-	Scalar generate(const Vec3 &normal, Ray &ray) const override;
-
-private:
-	const Scalar power;
-};
-
-class ConePDF : public PDF {
+// Plain PDF record, evaluated by a switch on its type
+class PDF {
 public:
-	ConePDF(Scalar cosMax): cosMax(cosMax), val(1. / (2. * M_PI * (1. - cosMax))) {}
-
-	inline Scalar value(const Vec3 &normal, const Ray &ray) const override {
-		const Scalar cosTheta = dot(normal, ray.direction);
-		return cosTheta < cosMax ? 0. : val;
+	static PDF cosine(Scalar power) { return PDF(COSINE, Vec3(), power); }
+	static PDF cone(Scalar cosMax) { return PDF(CONE, Vec3(), cosMax); }
+	static PDF targetCosine(const Vec3 &pos, Scalar radius) { return PDF(TARGET_COSINE, pos, 2. / (radius * radius)); }
+	static PDF targetCone(const Vec3 &pos, Scalar radius) { return PDF(TARGET_CONE, pos, radius * radius); }
+
+	inline Scalar value(const Vec3 &normal, const Ray &ray) const {
+		switch(type) {
+		case UNIFORM: return uniformVal;
+		case COSINE: return cosineValue(param, normal, ray);
+		case CONE: return coneValue(param, normal, ray);
+		case TARGET_COSINE: {
+			const Vec3 dir = pos - ray.origin;
+			const Scalar dist2 = dir.norm2();
+			return cosineValue(std::min(80., dist2 * param), dir / std::sqrt(dist2), ray);
+		}
+		default: {
+			const Vec3 dir = pos - ray.origin;
+			const Scalar inv_dist2 = 1. / dir.norm2();
+			return coneValue(1. / std::sqrt(1. + param * inv_dist2), dir * std::sqrt(inv_dist2), ray);
+		}
+		}
 	}
 
-	Scalar generate(const Vec3 &normal, Ray &ray) const override;
-
-private:
-	const Scalar cosMax;
-	const Scalar val;
-};
-
-class TargetCosinePDF : public PDF {
-public:
-	TargetCosinePDF(const Vec3 &pos, const Scalar radius): pos(pos), powerMul(2. / (radius * radius)) {}
+	// Direction from a point of the unit square
+	Scalar generate(const Vec3 &normal, Ray &ray, const Vec2 &u) const;
 
-	Scalar value(const Vec3 &normal, const Ray &ray) const override;
-	Scalar generate(const Vec3 &normal, Ray &ray) const override;
+	static const PDF uniform, lambertian;
+	static constexpr Scalar uniformVal = 1. / (4. * M_PI);
 
 private:
-	const Vec3 pos;
-	const Scalar powerMul;
-};
+	PDF(PDFType type, const Vec3 &pos, Scalar param): type(type), pos(pos), param(param) {}
 
-class TargetConePDF : public PDF {
-public:
-	TargetConePDF(const Vec3 &pos, const Scalar radius): pos(pos), rad2(radius * radius) {}
-
-	Scalar value(const Vec3 &normal, const Ray &ray) const override;
-	Scalar generate(const Vec3 &normal, Ray &ray) const override;
-
-private:
-	const Vec3 pos;
-	const Scalar rad2;
+	PDFType type;
+	Vec3 pos;
+	Scalar param; // power, cosMax, power multiplier or squared radius
 };
@@ -2,19 +2,53 @@
 
 #include "all.h"
 
-#include <random>
-#include <chrono>
+#include <cmath>
+#include <cstdint>
 
+// Counter-based generator: the i-th number of a stream is a hash of the stream key and of i, so that it only depends on
+// the seed, the pixel, the sample and the dimension, i.e. the rank of the draw in the sample, never on the thread drawing it.
+// The hash is the SplitMix64 finalizer of a Weyl sequence, two multiplications per number.
 class Random {
 public:
-	inline static void init(const int t) { re.seed(std::chrono::system_clock::now().time_since_epoch().count() + 123*t); }
+	// Seed of all the streams; the current thread draws from the stream of the scene construction
+	inline static void init(uint64_t s) {
+		seed = hash(s);
+		setStream(~uint64_t(0), 0);
+	}
 
-	inline static Scalar real() { return std::uniform_real_distribution<Scalar>(0., 1.)(re); }
-	inline static Scalar realNeg() { return std::uniform_real_distribution<Scalar>(-1., 1.)(re); }
-	inline static Scalar angle() { return std::uniform_real_distribution<Scalar>(0., 2.*M_PI)(re); }
-	inline static Scalar realRange(const Scalar a, const Scalar b) { return std::uniform_real_distribution<Scalar>(a, b)(re); }
-	inline static int intRange(int a, int b) { return std::uniform_int_distribution<int>(a, b)(re); }
+	// The following numbers are the dimensions of this sample of this pixel
+	inline static void setStream(uint64_t pixel, uint32_t sample) {
+		key = hash(seed ^ hash(pixel * Golden + sample));
+		counter = 0;
+	}
+
+	inline static uint64_t next() { return hash(key + (++ counter) * Golden); }
+
+	inline static Scalar real() { return (next() >> 11) * 0x1p-53; }
+	inline static Scalar realNeg() { return 2. * real() - 1.; }
+	inline static Scalar angle() { return 2. * M_PI * real(); }
+	inline static Scalar realRange(const Scalar a, const Scalar b) { return a + (b - a) * real(); }
+	inline static int intRange(int a, int b) { return a + int(((next() >> 32) * uint64_t(b - a + 1)) >> 32); }
+
+	static constexpr uint64_t Golden = 0x9e3779b97f4a7c15ull;
+
+	// SplitMix64 finalizer
+	static inline uint64_t hash(uint64_t z) {
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
 
 private:
-	inline static thread_local std::mt19937 re;
+
+	inline static uint64_t seed = 0;
+	inline static thread_local uint64_t key = 0, counter = 0;
+};
+
+// Uniform random bit generator drawing from Random, for the standard algorithms such as std::shuffle
+struct RandomBits {
+	using result_type = uint64_t;
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~uint64_t(0); }
+	inline result_type operator()() { return Random::next(); }
 };
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "hittable.h"
+
+// Axis-aligned rectangle, the common case of parallelograms in box-like scenes.
+// The hit is one divide and two range compares; bounds are stored along (axis+1)%3 and (axis+2)%3.
+class Rect {
+public:
+	// Expects b-a and c-a to be along two different axes
+	Rect(const Vec3 &a, const Vec3 &b, const Vec3 &c, bool biface=false);
+
+	static bool isAxisAligned(const Vec3 &a, const Vec3 &b, const Vec3 &c);
+
+	template<uint axis>
+	inline bool hit(const Ray &ray, Scalar tMax, Scalar &t) const {
+		constexpr uint y = (axis+1) % 3, z = (axis+2) % 3;
+		t = (plane - ray.origin[axis]) / ray.direction[axis];
+		if(t <= EPS || t >= tMax) return false;
+		const Scalar py = ray.origin[y] + t * ray.direction[y];
+		if(py < lo[0] || py > hi[0]) return false;
+		const Scalar pz = ray.origin[z] + t * ray.direction[z];
+		return pz >= lo[1] && pz <= hi[1];
+	}
+
+	AABB boundingBox() const;
+
+	inline Vec3 getNormal(const Vec3 &, const Ray &ray) const {
+		Vec3 normal;
+		normal[axis()] = (flags & NEGATIVE) ? -1. : 1.;
+		return (flags & BIFACE) && dot(normal, ray.direction) > 0. ? -normal : normal;
+	}
+
+	// Same parametrization as the parallelogram spanned by b-a and c-a
+	// World area mapped to the unit square of the UV
+	inline Scalar uvArea() const { return (Scalar(hi[0]) - lo[0]) * (Scalar(hi[1]) - lo[1]); }
+
+	inline Vec2 getUV(const Vec3 &pos, const Vec3 &) const {
+		Scalar u = (pos[(axis()+1)%3] - lo[0]) / (hi[0] - lo[0]);
+		Scalar v = (pos[(axis()+2)%3] - lo[1]) / (hi[1] - lo[1]);
+		if(flags & SWAP) std::swap(u, v);
+		return Vec2(flags & FLIP_U ? 1. - u : u, flags & FLIP_V ? 1. - v : v);
+	}
+
+	inline uint axis() const { return flags & AXIS; }
+
+private:
+	enum Flags : u_char { AXIS = 3, NEGATIVE = 4, BIFACE = 8, SWAP = 16, FLIP_U = 32, FLIP_V = 64 };
+
+	float plane;
+	float lo[2], hi[2];
+	u_char flags; // axis, sign of the normal, biface and orientation of the UV
+};
\ No newline at end of file
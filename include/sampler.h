@@ -0,0 +1,52 @@
+#pragma once
+
+#include "vec.h"
+
+enum SamplerType : u_char { INDEPENDENT, SOBOL, BLUE_NOISE };
+
+// Samples of the paths of a pixel. Each draw reads the next dimension of the sample, and every bounce starts at fixed
+// dimensions, so that the same event of all the paths of a pixel (e.g. the direction of the second bounce) is stratified.
+// SOBOL: each dimension is a 2D Sobol point set, Owen-scrambled with a hash of the pixel and of the dimension,
+// its sample index being shuffled the same way so that the dimensions are decorrelated (padding).
+// BLUE_NOISE: Sobol points with the same scrambling for all the pixels, the samples of a pixel being the block of the
+// sequence at its Z-order index, whose base 4 digits are permuted by a hash of the higher ones and of the dimension
+// (Ahmed and Wonka 2020). Neighbouring pixels draw complementary parts of the same net, so their errors cancel out
+// locally and what remains is high frequency noise, less visible at low sample counts. Best with a power of two spp.
+// The order of the samples within the block is shuffled like with SOBOL, which keeps the dimensions decorrelated.
+// Deeper bounces, where stratification is lost in the variance of the path, fall back to random numbers.
+// INDEPENDENT: plain random numbers from the stream of the sample.
+class Sampler {
+public:
+	Sampler(SamplerType type, uint width, uint height, uint spp);
+
+	// Draws are then the dimensions of the given sample of the pixel
+	void start(uint x, uint y, uint32_t index);
+	// Draws are then the dimensions of the given bounce
+	inline void bounce(uint depth) { dimension = PixelDimensions + depth * BounceDimensions; }
+
+	inline Scalar get1D() { return type != INDEPENDENT && dimension < SobolDimensions ? sobol1D() : Random::real(); }
+	inline Vec2 get2D() {
+		if(type != INDEPENDENT && dimension < SobolDimensions) return sobol2D();
+		const Scalar x = Random::real();
+		return Vec2(x, Random::real());
+	}
+
+private:
+	static constexpr uint PixelDimensions = 2; // position in the pixel, position on the lens
+	static constexpr uint BounceDimensions = 4;
+	static constexpr uint SobolDimensions = PixelDimensions + 4 * BounceDimensions;
+
+	// Sample index of the current dimension, bit reversed
+	uint32_t shuffledIndex(uint64_t key) const;
+	Scalar sobol1D();
+	Vec2 sobol2D();
+
+	SamplerType type;
+	uint width;
+	uint log2SPP, nbDigits;
+	uint64_t pixelKey = 0, sharedKey;
+	uint32_t reversedIndex = 0;
+	uint64_t pixelZ = ~uint64_t(0), pixelSeed = 0; // Z-order index of the pixel
+	uint64_t pixelDigits[SobolDimensions + 1]; // its permuted digits followed by log2 spp zeros, by dimension
+	uint dimension = 0;
+};
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "bvh.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "rect.h"
+#include "box.h"
+#include "medium.h"
+#include "mesh.h"
+#include "streaming.h"
+#include "compressedmesh.h"
+#include "lights.h"
+
+class Camera;
+
+// Primitives are stored by type and reached through the BVH leaves, without any virtual call.
+// Materials and textures are plain records referenced by index.
+// Everything lives in the scene arena and is released at once with the scene.
+class Scene {
+public:
+	Scene();
+	Scene(const Scene &) = delete;
+	Scene& operator=(const Scene &) = delete;
+
+	uint addTexture(const Texture &texture);
+	inline uint addTexture(const Color &color) { return addTexture(Texture::solid(color)); }
+	uint addNoise(Scalar scale);
+	uint addImage(const std::string &fileName);
+	// Image with the texture settings of the scene, allocated in storage, leaving the scene untouched
+	ImageTexture makeImage(const std::string &fileName, Arena &storage) const;
+	// Texture of an image set later, before building the scene
+	uint reserveImage();
+	// The scene takes over the storage of the image
+	void setImage(uint texture, const ImageTexture &image, std::shared_ptr<Arena> storage);
+	uint addMaterial(const Material &material);
+
+	PrimitiveRef add(const Sphere &sphere, bool visible=true);
+	PrimitiveRef addTriangle(const Vec3 &a, const Vec3 &b, const Vec3 &c, uint material, bool biface=false);
+	// Triangles of an indexed mesh, built in parallel
+	void addTriangles(const Vec3 *vertices, const uint *indices, size_t nbTriangles, uint material, bool biface=false);
+	// Triangles ordered along the leaves of their own BVH
+	void addMesh(const Triangle *triangles, size_t nbTriangles, const BVHNode *nodes, size_t nbNodes, uint material);
+	// Top-level BVH whose leaves index chunks from firstChunk in the chunk cache
+	void addStreamedMesh(const BVHNode *nodes, size_t nbNodes, uint firstChunk, uint material);
+
+	// Meshes loaded afterwards are streamed from disk, keeping about budget bytes of their chunks in memory
+	void setStreamingBudget(size_t budget);
+	inline bool streaming() const { return chunkCache != nullptr; }
+	inline ChunkCache& chunks() const { return *chunkCache; }
+	// Images loaded afterwards are paged in by tiles, keeping about budget bytes of them in memory
+	void setTextureBudget(size_t budget);
+	// Images loaded afterwards are stored as compressed blocks, decoded at lookup time
+	inline void setTextureCompression(bool compress) { compressTextures = compress; }
+	// Noise textures added afterwards are baked in a tile at construction instead of evaluated per lookup
+	inline void setNoiseBaking(bool bake) { bakeNoise = bake; }
+	// Bytes of the images as stored and uncompressed, and lowest PSNR of the compressed ones
+	void textureReport(size_t &storedSize, size_t &uncompressedSize, Scalar &psnr) const;
+
+	// Meshes loaded afterwards get levels of detail, ignored when streaming
+	void setLODLevels(uint levels);
+	inline uint lodLevels() const { return nbLODLevels; }
+	uint addLODMesh();
+	// Levels are added from the finest one
+	void addLODLevel(uint mesh, const Triangle *triangles, size_t nbTriangles, const BVHNode *nodes, size_t nbNodes, uint material);
+	// Meshes loaded afterwards are stored compressed, without levels of detail, unless streaming
+	inline void setMeshCompression(bool compress) { compressMeshes = compress; }
+	inline bool compressingMeshes() const { return compressMeshes; }
+	// Faces in the order of the leaves of the mesh BVH
+	void addCompressedMesh(const Vec3 *vertices, size_t nbVertices, const uint *indices, size_t nbTriangles, const BVHNode *nodes, size_t nbNodes, uint material);
+	// Bytes of the compressed meshes, and of the same meshes stored as triangles
+	void compressionReport(size_t &compressedSize, size_t &uncompressedSize) const;
+
+	// Picks for each LOD mesh the finest level with at most trianglesPerPixel triangles per pixel covered by its bounding sphere.
+	// All the rays trace that level, so that the rays leaving a surface see the same surface.
+	void selectLOD(const Camera &camera, int imgWidth, Scalar trianglesPerPixel=1.);
+	// Parallelogram spanned by b-a and c-a, stored as a Rect when axis-aligned
+	PrimitiveRef addQuad(const Vec3 &a, const Vec3 &b, const Vec3 &c, uint material, bool biface=false);
+	// Parallelepiped spanned by b-a, c-a and d-a
+	PrimitiveRef addBox(const Vec3 &a, const Vec3 &b, const Vec3 &c, const Vec3 &d, uint material, bool biface=false);
+	PrimitiveRef addMedium(PrimitiveRef boundary, Scalar density, const Color &albedo);
+
+	// Builds the BVH and reorders the primitives to follow its leaves, and the BVH of the emitters
+	void build();
+	// Emissive spheres, triangles and parallelograms, registered as they are added
+	inline const LightBVH& lights() const { return lightBVH; }
+
+	bool hit(const Ray &ray, Scalar tMax, HitRecord &record) const;
+	bool hitPrimitive(PrimitiveRef ref, const Ray &ray, Scalar tMax, Scalar &t) const;
+
+	AABB boundingBox(PrimitiveRef ref) const;
+	Vec3 getNormal(const HitRecord &record, const Vec3 &pos, const Ray &ray) const;
+	Vec2 getUV(const HitRecord &record, const Vec3 &pos) const;
+	// World area mapped to the unit square of the UV around the hit
+	Scalar uvArea(const HitRecord &record, const Vec3 &pos) const;
+
+	const Material& getMaterial(const HitRecord &record) const;
+	Color textureValue(uint texture, const HitRecord &record, const Vec3 &p) const;
+
+private:
+	// Luminance emitted by a material, 0 if it is not a light
+	Scalar emitted(uint material) const;
+	bool hitLeaf(const BVHNode &leaf, const Ray &ray, Scalar tMax, HitRecord &record) const;
+	inline const Triangle& planar(PrimitiveRef ref) const { return ref.type < QUAD_X ? triangles[ref.index] : quads[ref.index]; }
+	inline const PlanarShading& shading(PrimitiveRef ref) const {
+		return ref.type < QUAD_X ? triangleShading[ref.index] : ref.type < RECT_X ? quadShading[ref.index]
+			: ref.type < BOX ? rectShading[ref.index] : boxShading[ref.index];
+	}
+
+	Arena arena;
+	Pool<Sphere> spheres;
+	Pool<Triangle> triangles, quads;
+	Pool<Rect> rects;
+	Pool<Box> boxes;
+	Pool<PlanarShading> triangleShading, quadShading, rectShading, boxShading;
+	Pool<ConstantMedium> media;
+	Pool<Mesh> meshes;
+	Pool<StreamedMesh> streamed;
+	std::unique_ptr<ChunkCache> chunkCache;
+	Pool<LODMesh> lods;
+	uint nbLODLevels = 1;
+	Pool<CompressedMesh> compressed;
+	bool compressMeshes = false;
+	Pool<PrimitiveRef> visible;
+	Pool<Material> materials;
+	Pool<Texture> textures;
+	Pool<NoiseTexture> noises;
+	Pool<ImageTexture> images;
+	std::vector<std::shared_ptr<Arena>> imageStorage;
+	std::unique_ptr<TextureCache> pagedTextures;
+	bool compressTextures = false, bakeNoise = false;
+	BVH bvh;
+	LightBVH lightBVH;
+};
\ No newline at end of file
@@ -2,38 +2,40 @@
 
 #include "hittable.h"
 
-class Sphere : public Hittable {
+class Sphere {
 public:
-	Sphere(const Vec3 &center, Scalar radius, std::shared_ptr<Material> material, bool inverted=false):
+	Sphere(const Vec3 &center, Scalar radius, uint material, bool inverted=false):
 		center(center),
 		radius(radius),
-		material(std::move(material)),
-		inverted(inverted) {
-		Vec3 r(radius, radius, radius);
-		box = AABB(center - r, center + r);
-	}
+		material(material),
+		inverted(inverted) {}
 	
-	bool hit(const Ray &ray, Scalar tMax, HitRecord &record) const override;
+	bool hit(const Ray &ray, Scalar tMax, Scalar &t) const;
 
-	inline bool scatter(const Ray &ray, const HitRecord &record, ScatterRecord &out) const override {
-		return material->scatter(ray, record, out);
-	}
-	inline virtual Scalar scattering_pdf(const Vec3 &normal, const Ray &ray) const override {
-		return material->scattering_pdf(normal, ray);
+	inline AABB boundingBox() const {
+		Vec3 r(radius, radius, radius);
+		return AABB(center - r, center + r);
 	}
 
-	inline Vec3 getNormal(const Vec3 &pos, const Ray &) const override {
+	inline Vec3 getNormal(const Vec3 &pos, const Ray &) const {
 		if(inverted) return (center - pos) / radius;
 		else return (pos - center) / radius;
 	}
 
-	inline Vec2 getUV(const Vec3 &, const Vec3 &normal) const override {
+	inline Vec2 getUV(const Vec3 &, const Vec3 &normal) const {
 		return Vec2(.5 + std::atan2(-normal.z, normal.x) / (2.*M_PI), std::acos(-normal.y) / M_PI);
 	}
 
+	// World area mapped to the unit square of the UV
+	inline Scalar uvArea() const { return 4. * M_PI * radius * radius; }
+
+	inline uint getMaterial() const { return material; }
+	inline const Vec3& getCenter() const { return center; }
+	inline Scalar getRadius() const { return radius; }
+
 private:
 	Vec3 center;
 	Scalar radius;
-	std::shared_ptr<const Material> material;
+	uint material;
 	bool inverted;
 };
\ No newline at end of file
@@ -10,6 +10,10 @@ extern std::atomic<unsigned long long> sphereRayTest;
 extern thread_local unsigned long long localSphereRayTest;
 extern std::atomic<unsigned long long> triangleRayTest;
 extern thread_local unsigned long long localTriangleRayTest;
+extern std::atomic<unsigned long long> rectRayTest;
+extern thread_local unsigned long long localRectRayTest;
+extern std::atomic<unsigned long long> orientedBoxRayTest;
+extern thread_local unsigned long long localOrientedBoxRayTest;
 extern std::atomic<unsigned long long> nodeRayTest;
 extern thread_local unsigned long long localNodeRayTest;
 extern std::atomic<unsigned long long> hitBoxTest;
@@ -20,6 +24,10 @@ inline void aggregateLocalStats() {
 	localSphereRayTest = 0;
 	triangleRayTest += localTriangleRayTest;
 	localTriangleRayTest = 0;
+	rectRayTest += localRectRayTest;
+	localRectRayTest = 0;
+	orientedBoxRayTest += localOrientedBoxRayTest;
+	localOrientedBoxRayTest = 0;
 	nodeRayTest += localNodeRayTest;
 	localNodeRayTest = 0;
 	hitBoxTest += localHitBoxTest;
@@ -29,11 +37,15 @@ inline void aggregateLocalStats() {
 #ifdef STATS
 #define UPDATE_SPHERE_STATS ++ Stats::localSphereRayTest;
 #define UPDATE_TRIANGLE_STATS ++ Stats::localTriangleRayTest;
+#define UPDATE_RECT_STATS ++ Stats::localRectRayTest;
+#define UPDATE_ORIENTED_BOX_STATS ++ Stats::localOrientedBoxRayTest;
 #define UPDATE_NODE_STATS ++ Stats::localNodeRayTest;
 #define UPDATE_BOX_STATS ++ Stats::localHitBoxTest;
 #else
 #define UPDATE_SPHERE_STATS
 #define UPDATE_TRIANGLE_STATS
+#define UPDATE_RECT_STATS
+#define UPDATE_ORIENTED_BOX_STATS
 #define UPDATE_NODE_STATS
 #define UPDATE_BOX_STATS
 #endif
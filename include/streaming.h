@@ -0,0 +1,54 @@
+#pragma once
+
+#include "bvh.h"
+#include "mesh.h"
+#include "pagedcache.h"
+#include "triangle.h"
+
+// Out-of-core meshes: the triangles are split in spatial chunks stored on disk, each with its own BVH.
+// Only a top-level BVH over the chunks stays in memory, the chunks are paged in on demand.
+
+struct Chunk {
+	std::vector<BVHNode> nodes;
+	std::vector<Triangle> triangles;
+};
+
+// Location of a chunk in its file: nodes then triangles
+struct ChunkEntry {
+	uint64_t offset;
+	uint32_t nbNodes, nbTriangles;
+
+	inline size_t size() const { return nbNodes * sizeof(BVHNode) + nbTriangles * sizeof(Triangle); }
+};
+
+// Reads a chunk, returning its size in bytes
+size_t readChunk(int fd, const ChunkEntry &entry, Chunk &chunk);
+
+// Resident chunks of all the streamed meshes, within a memory budget
+using ChunkCache = PagedCache<ChunkEntry, Chunk, readChunk>;
+
+// Mesh whose triangles are reached through a chunk cache
+class StreamedMesh {
+public:
+	StreamedMesh(const BVHNode *nodes, uint firstChunk, uint material):
+		nodes(nodes),
+		firstChunk(firstChunk),
+		material(material) {}
+
+	// Sets the chunk and element of the record on a hit
+	bool hit(ChunkCache &cache, const Ray &ray, Scalar tMax, HitRecord &record) const;
+
+	inline const AABB& boundingBox() const { return nodes[0].box; }
+
+	inline uint getMaterial() const { return material; }
+
+private:
+	const BVHNode *nodes; // top-level BVH whose leaves index chunks
+	uint firstChunk;
+	uint material;
+};
+
+// Partitions a mesh, given with triangles in the order of its BVH leaves, into a chunk file
+void writeChunks(const std::string &fileName, uint64_t key, const std::vector<Triangle> &triangles, const BVH &bvh);
+// Commit of the streamed mesh of the chunk file of fileName if it was built with the same key, empty otherwise
+MeshCommit loadChunks(const std::string &fileName, uint64_t key, uint material);
\ No newline at end of file
@@ -1,65 +1,132 @@
 #pragma once
 
 #include "vec.h"
+#include "arena.h"
+#include "texturecache.h"
 
-class Hittable;
+#include <cstring>
 
-class Texture {
-public:
-	virtual Color value(const Hittable *hittable, const Vec3 &p, const Vec3 &normal) const = 0;
-};
-
-class SolidColor : public Texture {
-public:
-	SolidColor(Scalar r, Scalar g, Scalar b): color(r, g, b) {}
-	SolidColor(const Color &color): color(color) {}
+enum TextureType : u_char { SOLID_COLOR, CHECKER, NOISE, IMAGE };
 
-	inline Color value(const Hittable *, const Vec3 &, const Vec3 &) const override { return color; }
-
-private:
-	Color color;
-};
+// Plain texture record, noise tables and images are referenced by index
+struct Texture {
+	TextureType type;
+	uint data;
+	Color even, odd;
 
-class CheckerTexture : public Texture {
-public:
-	CheckerTexture() {}
-	CheckerTexture(const Color &even, const Color &odd): even(even), odd(odd) {}
+	static Texture solid(const Color &color) { return { SOLID_COLOR, 0, color, color }; }
+	static Texture checker(const Color &even, const Color &odd) { return { CHECKER, 0, even, odd }; }
+	static Texture noise(uint index) { return { NOISE, index, Color(), Color() }; }
+	static Texture image(uint index) { return { IMAGE, index, Color(), Color() }; }
 
-	inline Color value(const Hittable *, const Vec3 &p, const Vec3 &) const override {
+	inline Color checkerValue(const Vec3 &p) const {
 		if((std::sin(8.*p.x) < 0.) ^ (std::sin(8.*p.y) < 0.) ^ (std::sin(8.*p.z) < 0.)) return odd;
 		else return even;
 	}
-
-private:
-	Color even, odd;
 };
 
-class NoiseTexture : public Texture {
+class NoiseTexture {
 public:
-	NoiseTexture(Scalar scale);
-	~NoiseTexture() {
-		delete[] vecs;
-		delete[] perms[0];
-		delete[] perms[1];
-	}
+	// Baked noise reads its octaves from a periodic tile of gradient noise instead of evaluating them
+	NoiseTexture(Scalar scale, Arena &arena, bool baked=false);
 
-	Color value(const Hittable *hittable, const Vec3 &p, const Vec3 &normal) const override;
+	// Octaves finer than the footprint, the width of the filtered region, are dropped
+	Color value(const Vec3 &p, Scalar footprint=0.) const;
 
 private:
-	static const int nbVals = 1<<8;
-	Vec3 *vecs;
-	int *perms[2];
+	// Weighted sum of octaves of gradient noise at p, p 2^d, ... all evaluated together. Lattice coordinates are wrapped by mask.
+	Scalar gradientNoise(const Vec3 &p, const Scalar *weights, uint nbOctaves, int mask) const;
+	// Trilinear lookup in the baked tile
+	Scalar bakedNoise(const Vec3 &p) const;
+
+	static constexpr int nbVals = 1<<8;
+	static constexpr uint NbOctaves = 6;
+	// The tile covers BakedCells lattice cells with BakedSamples samples each, per axis, stored by bricks of 4x4x4
+	static constexpr int BakedCells = 64, BakedSamples = 2, BakedSize = BakedCells * BakedSamples, BakedBits = 7;
+	static inline uint bakedIndex(int i, int j, int k) {
+		return ((i >> 2) | (j >> 2) << (BakedBits-2) | (k >> 2) << (2*BakedBits-4)) << 6 | (i & 3) | (j & 3) << 2 | (k & 3) << 4;
+	}
+
+	const Scalar *gradients[3]; // coordinates of the random unit vectors
+	const int *perms[2];
+	const float *tile;
 	Scalar scale;
 };
 
-class ImageTexture : public Texture {
+class ImageTexture {
 public:
-	ImageTexture(std::string fileName);
-	~ImageTexture() { if(data != nullptr) delete data; }
+	// With a cache, the tiled levels are written next to the image once, then paged in on demand.
+	// Compressed textures store 4x4 blocks of 8 bytes, decoded at lookup time.
+	ImageTexture(std::string fileName, Arena &arena, TextureCache *cache=nullptr, bool compress=false);
+	// Empty, until an image is assigned to it
+	ImageTexture(): nbLevels(0), C(3), cache(nullptr), compressed(false), storedSize(0), quality(0.) {}
+
+	// Trilinear lookup in the mip pyramid, footprint being the width of the filtered region in texels of the full resolution
+	Color value(const Vec2 &uv, Scalar footprint) const;
+
+	// Texels per unit of UV area
+	inline Scalar texels() const { return Scalar(widths[0]) * heights[0]; }
 
-	Color value(const Hittable *hittable, const Vec3 &p, const Vec3 &normal) const override;
+	// Bytes of the levels as stored and uncompressed, and PSNR of the full resolution once compressed
+	inline size_t size() const { return storedSize; }
+	inline size_t uncompressedSize() const { return compressed ? storedSize * C * 16 / BlockSize : storedSize; }
+	inline Scalar psnr() const { return quality; }
 
 private:
-	u_char *data;
-	int W, H, C;
+	Color bilinear(uint level, const Vec2 &uv) const;
+
+	// Sizes and addressing tables of a level, returns its size in bytes
+	size_t setLevel(uint level, int width, int height, Arena &arena);
+	// Decodes the image and builds its tiled levels
+	void build(const std::string &fileName, Arena &arena, std::vector<std::vector<u_char>> &tiled);
+	// Replaces the texels of the levels by blocks and measures the error on the full resolution
+	void compress(std::vector<std::vector<u_char>> &tiled);
+	bool loadTileFile(const std::string &fileName, uint64_t key, Arena &arena);
+
+	// Texels are stored by tiles of TileSize x TileSize, in Morton order within and across the tiles.
+	// The bits of the index coming from the column and from the row are disjoint, so they are tabulated apart.
+	static constexpr uint TileBits = 3, TileSize = 1 << TileBits;
+	// Pages are runs of 64 tiles, i.e. squares of 64 x 64 texels on large enough levels
+	static constexpr uint PageBits = 2 * TileBits + 6;
+	// Runs of 16 texels of a tile are 4x4 squares, compressed as two RGB565 end points and 2-bit selectors in Morton order
+	static constexpr uint BlockSize = 8;
+
+	inline uint32_t index(uint level, int i, int j) const { return columnBits[level][i] | rowBits[level][j]; }
+	// Bytes before a texel, or its block, in its level or page
+	inline size_t offset(uint32_t id) const { return compressed ? BlockSize * (id >> 4) : C * id; }
+
+	static inline Color expand565(uint16_t c) {
+		return Color((c >> 11) * (255. / 31.), ((c >> 5) & 63) * (255. / 63.), (c & 31) * (255. / 31.));
+	}
+
+	static inline Color decodeBlock(const u_char *block, uint k) {
+		uint16_t ends[2];
+		uint32_t selectors;
+		std::memcpy(ends, block, 4);
+		std::memcpy(&selectors, block + 4, 4);
+		static constexpr Scalar weights[4] = { 0., 1., 1./3., 2./3. };
+		const Color a = expand565(ends[0]);
+		return a + weights[(selectors >> (2*k)) & 3] * (expand565(ends[1]) - a);
+	}
+	static void encodeBlock(const Color *texels, u_char *block);
+
+	// In [0, 255]
+	inline Color texel(uint level, int i, int j) const {
+		const uint32_t id = index(level, i, j);
+		const u_char *p = cache ? cache->page(firstPage[level] + (id >> PageBits)) + offset(id & ((1u << PageBits) - 1))
+								: levels[level] + offset(id);
+		return compressed ? decodeBlock(p, id & 15) : Color(p[0], p[1], p[2]);
+	}
+
+	static constexpr uint MaxLevels = 16;
+	const u_char *levels[MaxLevels]; // halved box filtered images, built at load time
+	const uint32_t *columnBits[MaxLevels], *rowBits[MaxLevels];
+	int widths[MaxLevels], heights[MaxLevels];
+	uint nbLevels;
+	int C;
+	TextureCache *cache;
+	uint firstPage[MaxLevels];
+	bool compressed;
+	size_t storedSize;
+	Scalar quality;
 };
\ No newline at end of file
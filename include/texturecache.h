@@ -0,0 +1,56 @@
+#pragma once
+
+#include "pagedcache.h"
+
+#include <array>
+#include <cstdint>
+
+// Paged textures: the tiled mip levels are stored in a file next to the image and read by pages on first touch.
+
+// Location of a page in its file
+struct PageEntry {
+	uint64_t offset;
+	uint32_t size;
+};
+
+// Reads a page, returning its size in bytes
+size_t readTexturePage(int fd, const PageEntry &entry, std::vector<u_char> &page);
+
+// Resident pages of all the paged textures, within a memory budget.
+// Each thread keeps its last pages in a small direct-mapped cache, so that most lookups take no lock nor atomic;
+// evicted pages stay alive while a thread still holds them there. Every TouchPeriod hits there still mark the page as used,
+// so that the hottest pages are not the first evicted.
+class TextureCache {
+public:
+	TextureCache(size_t budget);
+
+	// Registers the pages of a file and returns the id of the first one
+	inline uint addFile(const std::string &fileName, const std::vector<PageEntry> &pages) { return cache.addFile(fileName, pages); }
+
+	inline const u_char* page(uint id) {
+		MicroEntry &entry = micro[id & (MicroCacheSize-1)];
+		if(entry.cache != serial || entry.id != id) {
+			entry.page = cache.acquire(id);
+			entry.cache = serial;
+			entry.id = id;
+			entry.hits = 0;
+		} else if(++ entry.hits % TouchPeriod == 0) cache.touch(id);
+		return entry.page->data();
+	}
+
+	inline size_t residentSize() const { return cache.residentSize(); }
+
+private:
+	using Page = std::vector<u_char>;
+
+	static constexpr uint MicroCacheSize = 64, TouchPeriod = 64;
+	struct MicroEntry {
+		uint64_t cache = 0;
+		uint id = 0, hits = 0;
+		std::shared_ptr<const Page> page;
+	};
+	static thread_local std::array<MicroEntry, MicroCacheSize> micro;
+
+	uint64_t serial; // tells the caches apart in the thread caches, even at the same address
+	PagedCache<PageEntry, Page, readTexturePage> cache;
+};
\ No newline at end of file
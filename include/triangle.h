@@ -2,47 +2,63 @@
 
 #include "hittable.h"
 
-class Triangle : public Hittable {
+// Compact intersection record of a triangle or a parallelogram (40 bytes).
+// The Baldwin-Weber transform is stored in floats relative to the first vertex,
+// so that large coordinates do not cancel out; computations are still done in Scalar.
+// The bounding box only lives in the BVH and the material in the scene cold arrays.
+class Triangle {
 public:
-	Triangle(const Vec3 &a, const Vec3 &b, const Vec3 &c, std::shared_ptr<const Material> material, bool biface=false);
-	
-	virtual bool hit(const Ray &ray, Scalar tMax, HitRecord &record) const override;
+	Triangle() = default;
+	Triangle(const Vec3 &a, const Vec3 &b, const Vec3 &c, bool biface=false);
 
-	inline bool scatter(const Ray &ray, const HitRecord &record, ScatterRecord &out) const override {
-		return material->scatter(ray, record, out);
+	// Baldwin-Weber test with the dropped coordinate known at compile time
+	template<uint axis, bool quad>
+	inline bool hit(const Ray &ray, Scalar tMax, Scalar &t) const {
+		constexpr uint y = (axis+1) % 3, z = (axis+2) % 3;
+		const Scalar ox = ray.origin[axis] - origin[axis], oy = ray.origin[y] - origin[y], oz = ray.origin[z] - origin[z];
+		t = - (ox + rows[4] * oy + rows[5] * oz) / (ray.direction[axis] + rows[4] * ray.direction[y] + rows[5] * ray.direction[z]);
+		if(t <= EPS || t >= tMax) return false;
+		const Scalar py = oy + t * ray.direction[y], pz = oz + t * ray.direction[z];
+		const Scalar u = rows[0] * py + rows[1] * pz;
+		if(u < 0. || (quad && u > 1.)) return false;
+		const Scalar v = rows[2] * py + rows[3] * pz;
+		if(quad) return v >= 0. && v <= 1.;
+		else return v >= 0. && u + v <= 1.;
 	}
-	inline virtual Scalar scattering_pdf(const Vec3 &normal, const Ray &ray) const override {
-		return material->scattering_pdf(normal, ray);
+
+	AABB boundingBox(bool quad) const;
+
+	inline Vec3 getNormal(const Vec3 &, const Ray &ray) const {
+		Vec3 normal;
+		normal[axis()] = 1.;
+		normal[(axis()+1)%3] = rows[4];
+		normal[(axis()+2)%3] = rows[5];
+		normal /= (flags & NEGATIVE) ? -normal.norm() : normal.norm();
+		return (flags & BIFACE) && dot(normal, ray.direction) > 0. ? -normal : normal;
 	}
 
-	inline Vec3 getNormal(const Vec3 &, const Ray &ray) const override {
-		return biface && dot(normal, ray.direction) > 0. ? -normal : normal;
+	inline Vec2 getUV(const Vec3 &pos, const Vec3 &) const {
+		const Scalar y = pos[(axis()+1)%3] - origin[(axis()+1)%3], z = pos[(axis()+2)%3] - origin[(axis()+2)%3];
+		return Vec2(rows[0] * y + rows[1] * z, rows[2] * y + rows[3] * z);
 	}
 
-	inline Vec2 getUV(const Vec3 &pos, const Vec3 &) const override {
-		Scalar x = pos[(1+fixedColumn)%3], y = pos[(2+fixedColumn)%3];
-		return Vec2(invT[0] * x + invT[1] * y + invT[2],
-					invT[3] * x + invT[4] * y + invT[5]);
+	// World area mapped to the unit square of the UV, the norm of the cross product of the edges
+	inline Scalar uvArea() const {
+		const Scalar det = Scalar(rows[0]) * rows[3] - Scalar(rows[1]) * rows[2];
+		return std::sqrt(1. + Scalar(rows[4]) * rows[4] + Scalar(rows[5]) * rows[5]) / std::abs(det);
 	}
 
-protected:
-	Triangle(std::shared_ptr<const Material> material, bool biface): material(std::move(material)), biface(biface) {}
-	void init(const Vec3 &a, const Vec3 &b, const Vec3 &c);
+	inline uint axis() const { return flags & AXIS; }
 
-	Vec3 normal;
-	std::shared_ptr<const Material> material;
-	bool biface;
-	unsigned char fixedColumn;
-	Scalar invT[9];
-};
+private:
+	enum Flags : u_char { AXIS = 3, NEGATIVE = 4, BIFACE = 8 };
 
-class Quad : public Triangle {
-public:
-	Quad(const Vec3 &a, const Vec3 &b, const Vec3 &c, std::shared_ptr<const Material> material, bool biface=false);
-	
-	bool hit(const Ray &ray, Scalar tMax, HitRecord &record) const override;
+	float origin[3];
+	float rows[6]; // u, v and plane rows applied to the two kept coordinates
+	u_char flags; // dominant axis, sign of the normal along it, biface
 };
 
-void loadOBJ(const std::string &fileName, HittableList &list, const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos, std::shared_ptr<Material> material);
-void addBox(HittableList &list, const Vec3 &a, const Vec3 &b, const Vec3 &c, const Vec3 &d, std::shared_ptr<const Material> material, bool biface=false);
-void addBoxRotY(HittableList &list, const Vec3 &size, const Vec3 &pos, Scalar angle, std::shared_ptr<const Material> material, bool biface=false);
\ No newline at end of file
+// Data of triangles, quads, rects and boxes only needed once they are hit
+struct PlanarShading {
+	uint material;
+};
\ No newline at end of file
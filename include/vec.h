@@ -30,6 +30,13 @@ public:
 		const Scalar r = R * std::sqrt(Random::real());
 		return Vec2(r * std::cos(alpha), r * std::sin(alpha));
 	}
+
+	// Point of the disc from a point of the unit square
+	static inline Vec2 disc(const Vec2 &u, Scalar R) {
+		const Scalar alpha = 2. * M_PI * u.x;
+		const Scalar r = R * std::sqrt(u.y);
+		return Vec2(r * std::cos(alpha), r * std::sin(alpha));
+	}
 };
 
 inline std::ostream& operator<<(std::ostream &stream, const Vec2 &v) {
@@ -54,18 +61,22 @@ public:
 		return Vec3(Random::realRange(a, b), Random::realRange(a, b), Random::realRange(a, b));
 	}
 	static inline Vec3 randomBall() {
-		const Scalar phi = Random::angle();
-		const Scalar cosTheta = Random::realNeg();
-		const Scalar sinTheta = std::sqrt(1. - cosTheta*cosTheta);
-		const Scalar r = std::cbrt(Random::real());
-		return Vec3(r * sinTheta * std::cos(phi), r * sinTheta * std::sin(phi), r * cosTheta);
+		const Scalar u = Random::real();
+		const Scalar v = Random::real();
+		return ball(Vec2(u, v), Random::real());
 	}
 	static inline Vec3 randomSphere() {
-		const Scalar phi = Random::angle();
-		const Scalar cosTheta = Random::realNeg();
+		const Scalar u = Random::real();
+		return sphere(Vec2(u, Random::real()));
+	}
+	// Points of the unit sphere and ball from points of the unit square and cube
+	static inline Vec3 sphere(const Vec2 &u) {
+		const Scalar phi = 2. * M_PI * u.x;
+		const Scalar cosTheta = 2. * u.y - 1.;
 		const Scalar sinTheta = std::sqrt(1. - cosTheta*cosTheta);
 		return Vec3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
 	}
+	static inline Vec3 ball(const Vec2 &u, Scalar w) { return sphere(u) * std::cbrt(w); }
 
 	inline Vec3 operator-() const { return Vec3(-x, -y, -z); }
 
@@ -138,8 +149,10 @@ typedef Vec3 Color;
 class Ray {
 public:
 	Vec3 origin, direction;
+	Scalar width = 0., spread = 0.; // cone around the ray, used to filter textures
 
 	Ray() = default;
 	Ray(const Vec3 &origin, const Vec3 &direction): origin(origin), direction(direction) {}
 	inline Vec3 at(Scalar t) const { return origin + t * direction; }
+	inline Scalar widthAt(Scalar t) const { return width + spread * t; }
 };
\ No newline at end of file
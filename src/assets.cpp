@@ -0,0 +1,49 @@
+#include "assets.h"
+#include "scene.h"
+#include "mappedfile.h"
+
+#include <filesystem>
+
+uint64_t AssetLoader::contentHash(const std::string &fileName) {
+	const std::string path = std::filesystem::weakly_canonical(fileName).string();
+	const auto it = hashes.find(path);
+	if(it != hashes.end()) return it->second;
+	return hashes[path] = MappedFile(fileName).hash();
+}
+
+uint AssetLoader::image(const std::string &fileName) {
+	const uint64_t hash = contentHash(fileName);
+	const auto it = images.find(hash);
+	if(it != images.end()) return it->second;
+	const uint texture = images[hash] = scene.reserveImage();
+	commits.push_back(pool.submit([this, fileName, texture]() -> Commit {
+		const std::shared_ptr<Arena> storage = std::make_shared<Arena>();
+		const ImageTexture image = scene.makeImage(fileName, *storage);
+		return [texture, image, storage](Scene &scene) { scene.setImage(texture, image, storage); };
+	}));
+	return texture;
+}
+
+void AssetLoader::mesh(const std::string &fileName, const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos, uint material) {
+	const std::string extension = std::filesystem::path(fileName).extension().string();
+	const MeshParser parse = extension == ".obj" ? parseOBJ : extension == ".ply" ? parsePLY : nullptr;
+	if(!parse) throw std::runtime_error("Unknown mesh format " + extension + "!");
+	const uint64_t hash = contentHash(fileName);
+	std::shared_ptr<Source> &source = sources[hash];
+	if(!source) source = std::make_shared<Source>();
+	const uint64_t key = meshKey(hash, rotAxis, angle, scale, pos);
+	commits.push_back(pool.submit([this, fileName, parse, source, key, rotAxis, angle, scale, pos, material]() -> Commit {
+		const MeshSource read = [&](std::vector<Vec3> &vertices, std::vector<uint> &indices) {
+			std::call_once(source->parsed, [&]() { parse(fileName, MappedFile(fileName), source->vertices, source->indices); });
+			vertices = source->vertices;
+			indices = source->indices;
+		};
+		return prepareMesh(fileName, key, scene, read, rotAxis, angle, scale, pos, material);
+	}));
+}
+
+void AssetLoader::finish() {
+	// In request order, so that the scene does not depend on which job ended first
+	for(std::future<Commit> &commit : commits) commit.get()(scene);
+	commits.clear();
+}
\ No newline at end of file
@@ -0,0 +1,49 @@
+#include "box.h"
+#include "scene.h"
+
+#include "stats.h"
+
+std::atomic<unsigned long long> Stats::orientedBoxRayTest = {0uLL};
+thread_local unsigned long long Stats::localOrientedBoxRayTest = 0uLL;
+
+Box::Box(const Vec3 &a, const Vec3 &b, const Vec3 &c, const Vec3 &d, bool biface) {
+	const Vec3 e[3] = { b - a, c - a, d - a };
+	const Scalar det = dot(e[0], cross(e[1], e[2]));
+	if(det == 0.) throw std::runtime_error("Degenerated box!");
+	for(uint i = 0; i < 3; ++i) {
+		origin[i] = a[i];
+		const Vec3 row = cross(e[(i+1)%3], e[(i+2)%3]) / det;
+		for(uint j = 0; j < 3; ++j) rows[3*i+j] = row[j];
+	}
+	flags = biface ? BIFACE : 0;
+}
+
+// Recovers the edges by inverting the stored matrix
+AABB Box::boundingBox() const {
+	Vec3 r[3], a;
+	for(uint i = 0; i < 3; ++i) {
+		r[i] = Vec3(rows[3*i], rows[3*i+1], rows[3*i+2]);
+		a[i] = origin[i];
+	}
+	const Scalar det = dot(r[0], cross(r[1], r[2]));
+	Vec3 mini = a, maxi = a;
+	for(uint i = 1; i < 8; ++i) {
+		Vec3 p = a;
+		for(uint j = 0; j < 3; ++j)
+			if(i & (1 << j)) p += cross(r[(j+1)%3], r[(j+2)%3]) / det;
+		mini = min(mini, p);
+		maxi = max(maxi, p);
+	}
+	// Pad for the rounding of the recovered corners
+	const Vec3 pad = (maxi - mini) * 1e-6 + Vec3(.5*EPS, .5*EPS, .5*EPS);
+	return AABB(mini - pad, maxi + pad);
+}
+
+void addBoxRotY(Scene &scene, const Vec3 &size, const Vec3 &pos, Scalar angle, uint material, bool biface) {
+	angle *= M_PI / 180.;
+	const Scalar co = std::cos(angle), si = std::sin(angle);
+	const Vec3 b = pos + size.x * Vec3(co,  0., si);
+	const Vec3 c = pos + size.y * Vec3(0.,  1., 0.);
+	const Vec3 d = pos + size.z * Vec3(-si, 0., co);
+	scene.addBox(pos, b, c, d, material, biface);
+}
\ No newline at end of file
@@ -1,148 +1,107 @@
 #include "bvh.h"
 
-#include "stats.h"
 #include <algorithm>
-#include <queue>
 
 std::atomic<unsigned long long> Stats::nodeRayTest = {0uLL};
 thread_local unsigned long long Stats::localNodeRayTest = 0uLL;
 
-BVHNode::BVHNode(std::vector<std::shared_ptr<const Hittable>>::iterator start, size_t nb) {
-	if(nb < 2) throw std::runtime_error("Not enougth hittables in BVHNode!");
+void BVH::build(std::vector<BVHPrimitive> &primitives) {
+	nodes.clear();
+	if(primitives.empty()) return;
+	nodes.reserve(2 * primitives.size());
+	std::vector<Scalar> surfaces(primitives.size());
+	if(build(primitives.begin(), primitives.size(), 0, surfaces.data()) > MaxDepth) throw std::runtime_error("BVH is too deep!");
+}
 
-	uint axis;
-	auto comp = [&axis](const std::shared_ptr<const Hittable> &a, const std::shared_ptr<const Hittable> &b) {
-		return a->boundingBox().max()[axis] < b->boundingBox().max()[axis];
-	};
+int BVH::addLeaf(std::vector<BVHPrimitive>::iterator start, size_t nb, size_t offset) {
+	BVHNode &node = nodes.emplace_back();
+	node.box = start->box;
+	for(auto it = start+1; it != start+nb; ++it) node.box.surround(it->box);
+	node.index = offset;
+	node.count = nb;
+	node.type = start->ref.type;
+	return 1;
+}
 
-	uint bestAxis = 0;
-	uint bestSep = 1;
-	Scalar bestScore = std::numeric_limits<Scalar>::max();
-	std::vector<Scalar> surfaces(nb-1);
-	for(axis = 0; axis < 3; ++axis) {
-		std::sort(start, start+nb, comp);
-		uint i = 0;
-		box = (*start)->boundingBox();
-		while(true) {
-			surfaces[i] = box.surface();
-			if(++i < surfaces.size()) box.surround((*(start+i))->boundingBox());
-			else break;
-		}
-		i = nb-1;
-		box = (*(start+i))->boundingBox();
-		while(true) {
-			double score = box.surface() * (nb - i) + surfaces[i-1] * i;
-			if(score < bestScore) {
-				bestScore = score;
-				bestAxis = axis;
-				bestSep = i;
-			}
-			if(--i > 0) box.surround((*(start+i))->boundingBox());
-			else break;
-		}
-	}
+int BVH::depth(const BVHNode *nodes, uint n) {
+	if(nodes[n].isLeaf()) return 1;
+	return 1 + std::max(depth(nodes, n+1), depth(nodes, nodes[n].index));
+}
 
-	if(bestAxis < 2) {
-		axis = bestAxis;
-		std::sort(start, start+nb, comp);
+// End of the subtree of node n, 0 if it is not laid out as by build
+static size_t validSubtree(const BVHNode *nodes, size_t nbNodes, size_t n, int depth, size_t nbPrimitives, bool triangleLeaves) {
+	if(n >= nbNodes || depth > BVH::MaxDepth) return 0;
+	const BVHNode &node = nodes[n];
+	if(node.isLeaf()) {
+		if(triangleLeaves && (node.type < TRIANGLE_X || node.type > TRIANGLE_Z)) return 0;
+		return (uint64_t) node.index + node.count <= nbPrimitives ? n+1 : 0;
 	}
-
-	if(bestSep == 1) left = *start;
-	else left = std::make_shared<BVHNode>(start, bestSep);
-	if(bestSep+1 == nb) right = *(start + bestSep);
-	else right = std::make_shared<BVHNode>(start + bestSep, nb-bestSep);
-
-	box = left->boundingBox();
-	box.surround(right->boundingBox());
+	const size_t right = validSubtree(nodes, nbNodes, n+1, depth+1, nbPrimitives, triangleLeaves);
+	if(right == 0 || node.index != right) return 0;
+	return validSubtree(nodes, nbNodes, right, depth+1, nbPrimitives, triangleLeaves);
 }
 
-bool BVHNode::hit(const Ray &ray, Scalar tMax, HitRecord &record) const {
-	UPDATE_NODE_STATS
-	Scalar t0Left;
-	if(left->hitBox(ray, tMax, t0Left)) {
-		Scalar t0Right;
-		if(right->hitBox(ray, tMax, t0Right)) {
-			if(t0Left < t0Right) {
-				if(left->hit(ray, tMax, record)) {
-					if(record.t > t0Right) right->hit(ray, record.t, record);
-					return true;
-				} else return right->hit(ray, tMax, record);
-			} else {
-				if(right->hit(ray, tMax, record)) {
-					if(record.t > t0Left) left->hit(ray, record.t, record);
-					return true;
-				} else return left->hit(ray, tMax, record);
-			}
-		} else return left->hit(ray, tMax, record);
-	} else return right->hit(ray, tMax, record);
+bool BVH::valid(const BVHNode *nodes, size_t nbNodes, size_t nbPrimitives, bool triangleLeaves) {
+	if(nbNodes == 0) return nbPrimitives == 0;
+	return validSubtree(nodes, nbNodes, 0, 1, nbPrimitives, triangleLeaves) == nbNodes;
 }
 
+int BVH::build(std::vector<BVHPrimitive>::iterator start, size_t nb, size_t offset, Scalar *surfaces) {
+	if(nb == 1) return addLeaf(start, nb, offset);
 
-typedef std::pair<Scalar, const Hittable*> QElement;
-struct qComp {
-	inline bool operator()(const QElement &a, const QElement &b) const {
-		return a.first > b.first;
-	}
-};
+	uint bestSep = 1;
+	if(nb <= MaxLeafSize) {
+		// Group small ranges by type so that each leaf dispatches once
+		std::sort(start, start+nb, [](const BVHPrimitive &a, const BVHPrimitive &b) { return a.ref.type < b.ref.type; });
+		const PrimitiveType type = start->ref.type;
+		while(type != MESH && bestSep < nb && (start+bestSep)->ref.type == type) ++ bestSep;
+		if(bestSep == nb) return addLeaf(start, nb, offset);
+	} else {
+		uint axis;
+		auto comp = [&axis](const BVHPrimitive &a, const BVHPrimitive &b) {
+			return a.box.max()[axis] < b.box.max()[axis];
+		};
 
-bool BVHTree::hit(const Ray &ray, Scalar tMax, HitRecord &record) const {
-	Ray rayInv(ray.origin, 1. / ray.direction);
-	bool anyHit = false;
-	std::priority_queue<QElement, std::vector<QElement>, qComp> Q;
-	Q.emplace(EPS, root.get());
-	while(!Q.empty()) {
-		if(Q.top().first >= tMax) break;
-		const Hittable* h = Q.top().second;
-		Q.pop();
-		Scalar t0 = Q.empty() ? std::numeric_limits<Scalar>::max() : Q.top().first + EPS;
-		Scalar t;
-		while(h->isNode()) {
-			UPDATE_NODE_STATS
-			const BVHNode *node = static_cast<const BVHNode*>(h);
-			if(node->left->hitBoxInv(rayInv, tMax, t)) {
-				Scalar t2;
-				if(node->right->hitBoxInv(rayInv, tMax, t2)) {
-					if(t < t2) {
-						Q.emplace(t2, node->right.get());
-						if(t < t0) {
-							h = node->left.get();
-							t2 += EPS;
-							if(t2 < t0) t0 = t2;
-						} else {
-							Q.emplace(t, node->left.get());
-							break;
-						}
-					} else {
-						Q.emplace(t, node->left.get());
-						if(t2 < t0) {
-							h = node->right.get();
-							t += EPS;
-							if(t < t0) t0 = t;
-						} else {
-							Q.emplace(t2, node->right.get());
-							break;
-						}
-					}
-				} else if(t < t0) {
-					h = node->left.get();
-				} else {
-					Q.emplace(t, node->left.get());
-					break;
-				}
-			} else if(Stats::localHitBoxTest&3) h = node->right.get();
-			else if(node->right->hitBoxInv(rayInv, tMax, t)) {
-				if(t < t0) h = node->right.get();
-				else {
-					Q.emplace(t, node->right.get());
-					break;
+		uint bestAxis = 0;
+		Scalar bestScore = std::numeric_limits<Scalar>::max();
+		AABB box;
+		for(axis = 0; axis < 3; ++axis) {
+			std::sort(start, start+nb, comp);
+			uint i = 0;
+			box = start->box;
+			while(true) {
+				surfaces[i] = box.surface();
+				if(++i < nb-1) box.surround((start+i)->box);
+				else break;
+			}
+			i = nb-1;
+			box = (start+i)->box;
+			while(true) {
+				double score = box.surface() * (nb - i) + surfaces[i-1] * i;
+				if(score < bestScore) {
+					bestScore = score;
+					bestAxis = axis;
+					bestSep = i;
 				}
-			} else break;
+				if(--i > 0) box.surround((start+i)->box);
+				else break;
+			}
 		}
 
-		if(!h->isNode() && h->hit(ray, tMax, record)) {
-			anyHit = true;
-			tMax = record.t;
+		if(bestAxis < 2) {
+			axis = bestAxis;
+			std::sort(start, start+nb, comp);
 		}
 	}
-	return anyHit;
+
+	const size_t id = nodes.size();
+	nodes.emplace_back();
+	int depth = build(start, bestSep, offset, surfaces);
+	nodes[id].index = nodes.size();
+	depth = std::max(depth, build(start + bestSep, nb - bestSep, offset + bestSep, surfaces));
+	BVHNode &node = nodes[id];
+	node.box = nodes[id+1].box;
+	node.box.surround(nodes[node.index].box);
+	node.count = 0;
+	return depth + 1;
 }
\ No newline at end of file
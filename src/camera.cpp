@@ -3,6 +3,7 @@
 Camera::Camera(const Vec3 &pos, const Vec3 &direction, const Vec3 &up, Scalar fov, Scalar aspectRatio, Scalar aperture, Scalar focusDistance): pos(pos) {
 	fov *= M_PI / 180.;
 	const Scalar width = 2. * std::tan(fov / 2.);
+	viewWidth = width;
 	const Scalar height = width / aspectRatio;
 	const Vec3 w = direction.normalized();
 
@@ -17,8 +18,10 @@ Camera::Camera(const Vec3 &pos, const Vec3 &direction, const Vec3 &up, Scalar fo
 	lensRadius = .5 * aperture;
 }
 
-Ray Camera::getRay(Scalar x, Scalar y) const {
-	const Vec2 offset = Vec2::randomDisc(lensRadius);
+Ray Camera::getRay(Scalar x, Scalar y, Sampler &sampler) const {
+	const Vec2 offset = Vec2::disc(sampler.get2D(), lensRadius);
 	const Vec3 origin = pos + offset.x * u + offset.y * v;
-	return Ray(origin, (corner + x * horizontal + y * vertical - origin).normalized());
+	Ray ray(origin, (corner + x * horizontal + y * vertical - origin).normalized());
+	ray.spread = pixelSpread;
+	return ray;
 }
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "compressedmesh.h"
+#include "triangle.h"
+#include "stats.h"
+
+#include <limits>
+
+namespace {
+
+// Octahedral mapping of a unit vector to two 16-bit values
+void encodeNormal(Vec3 n, uint16_t code[2]) {
+	n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	Scalar x = n.x, y = n.y;
+	if(n.z < 0.) {
+		x = (1. - std::abs(n.y)) * (n.x < 0. ? -1. : 1.);
+		y = (1. - std::abs(n.x)) * (n.y < 0. ? -1. : 1.);
+	}
+	code[0] = std::lround((.5 * x + .5) * 65535.);
+	code[1] = std::lround((.5 * y + .5) * 65535.);
+}
+
+Vec3 decodeNormal(const uint16_t code[2]) {
+	const Scalar x = code[0] * (2. / 65535.) - 1., y = code[1] * (2. / 65535.) - 1.;
+	Vec3 n(x, y, 1. - std::abs(x) - std::abs(y));
+	if(n.z < 0.) {
+		n.x = (1. - std::abs(y)) * (x < 0. ? -1. : 1.);
+		n.y = (1. - std::abs(x)) * (y < 0. ? -1. : 1.);
+	}
+	return n.normalized();
+}
+
+// Möller-Trumbore test on decoded vertices
+inline bool hitTriangle(const Vec3 &a, const Vec3 &b, const Vec3 &c, const Ray &ray, Scalar tMax, Scalar &t) {
+	const Vec3 e1 = b - a, e2 = c - a;
+	const Vec3 p = cross(ray.direction, e2);
+	const Scalar det = dot(e1, p);
+	if(det == 0.) return false;
+	const Scalar inv = 1. / det;
+	const Vec3 s = ray.origin - a;
+	const Scalar u = dot(s, p) * inv;
+	if(u < 0. || u > 1.) return false;
+	const Vec3 q = cross(s, e1);
+	const Scalar v = dot(ray.direction, q) * inv;
+	if(v < 0. || u + v > 1.) return false;
+	t = dot(e2, q) * inv;
+	return t > EPS && t < tMax;
+}
+
+}
+
+CompressedMesh::CompressedMesh(const Vec3 *positions, size_t nbPositions, const uint *indices, size_t nbTriangles,
+								const BVHNode *meshNodes, size_t nbNodes, uint material, Arena &arena):
+	nbNodes(nbNodes),
+	nbTriangles(nbTriangles),
+	material(material) {
+	// Vertices in the order of their first use, so that the vertices of a triangle are close
+	std::vector<uint> remap(nbPositions, std::numeric_limits<uint>::max()), order;
+	for(size_t i = 0; i < 3 * nbTriangles; ++i)
+		if(remap[indices[i]] == std::numeric_limits<uint>::max()) {
+			remap[indices[i]] = order.size();
+			order.push_back(indices[i]);
+		}
+	nbVertices = order.size();
+
+	lo = positions[order[0]];
+	Vec3 hi = lo;
+	for(uint v : order) {
+		lo = min(lo, positions[v]);
+		hi = max(hi, positions[v]);
+	}
+	step = (hi - lo) / 65535.;
+	vertices = arena.alloc<uint16_t>(3 * nbVertices);
+	for(size_t v = 0; v < nbVertices; ++v)
+		for(uint k = 0; k < 3; ++k)
+			vertices[3*v+k] = step[k] > 0. ? std::lround((positions[order[v]][k] - lo[k]) / step[k]) : 0;
+
+	triangles = arena.alloc<CompressedTriangle>(nbTriangles);
+	std::vector<uint> escaped;
+	for(size_t f = 0; f < nbTriangles; ++f) {
+		CompressedTriangle &tri = triangles[f];
+		const uint ids[3] = { remap[indices[3*f]], remap[indices[3*f+1]], remap[indices[3*f+2]] };
+		const long d1 = (long) ids[1] - ids[0], d2 = (long) ids[2] - ids[0];
+		if(std::max(std::abs(d1), std::abs(d2)) <= 32767) {
+			tri.v0 = ids[0];
+			tri.d1 = d1;
+			tri.d2 = d2;
+		} else {
+			tri.v0 = escaped.size();
+			tri.d1 = CompressedTriangle::Escape;
+			tri.d2 = 0;
+			escaped.insert(escaped.end(), ids, ids + 3);
+		}
+		const Vec3 &a = positions[indices[3*f]];
+		encodeNormal(cross(positions[indices[3*f+1]] - a, positions[indices[3*f+2]] - a).normalized(), tri.normal);
+	}
+	nbEscapes = escaped.size();
+	escapes = arena.alloc<uint>(nbEscapes);
+	std::copy(escaped.begin(), escaped.end(), escapes);
+
+	// The boxes are refitted around the decoded vertices, children being after their parent
+	nodes = arena.alloc<BVHNode>(nbNodes);
+	std::copy(meshNodes, meshNodes + nbNodes, nodes);
+	const Vec3 pad(.5*EPS, .5*EPS, .5*EPS);
+	for(size_t n = nbNodes; n-- > 0;) {
+		BVHNode &node = nodes[n];
+		if(node.isLeaf()) {
+			Vec3 a, b, c;
+			decode(node.index, a, b, c);
+			Vec3 mini = min(a, min(b, c)), maxi = max(a, max(b, c));
+			for(uint i = node.index + 1; i < node.index + node.count; ++i) {
+				decode(i, a, b, c);
+				mini = min(mini, min(a, min(b, c)));
+				maxi = max(maxi, max(a, max(b, c)));
+			}
+			node.box = AABB(mini - pad, maxi + pad);
+		} else {
+			node.box = nodes[n+1].box;
+			node.box.surround(nodes[node.index].box);
+		}
+	}
+}
+
+bool CompressedMesh::hit(const Ray &ray, Scalar tMax, HitRecord &record) const {
+	return BVH::hit(nodes, ray, tMax, record, [this](const BVHNode &leaf, const Ray &ray, Scalar tMax, HitRecord &record) {
+		bool anyHit = false;
+		Scalar t;
+		Vec3 a, b, c;
+		for(uint i = leaf.index; i < leaf.index + leaf.count; ++i) {
+			UPDATE_TRIANGLE_STATS
+			decode(i, a, b, c);
+			if(hitTriangle(a, b, c, ray, tMax, t)) {
+				record.t = tMax = t;
+				record.element = i;
+				anyHit = true;
+			}
+		}
+		return anyHit;
+	});
+}
+
+Vec3 CompressedMesh::getNormal(uint triangle) const {
+	return decodeNormal(triangles[triangle].normal);
+}
+
+Vec2 CompressedMesh::getUV(uint triangle, const Vec3 &pos) const {
+	Vec3 a, b, c;
+	decode(triangle, a, b, c);
+	// Barycentric coordinates along b-a and c-a, as for uncompressed triangles
+	const Vec3 e1 = b - a, e2 = c - a, n = cross(e1, e2), p = pos - a;
+	const Scalar in = 1. / n.norm2();
+	return Vec2(dot(cross(p, e2), n) * in, dot(cross(e1, p), n) * in);
+}
+
+Scalar CompressedMesh::uvArea(uint triangle) const {
+	Vec3 a, b, c;
+	decode(triangle, a, b, c);
+	return cross(b - a, c - a).norm();
+}
+
+size_t CompressedMesh::size() const {
+	return nbNodes * sizeof(BVHNode) + 3 * nbVertices * sizeof(uint16_t) + nbTriangles * sizeof(CompressedTriangle) + nbEscapes * sizeof(uint);
+}
+
+size_t CompressedMesh::uncompressedSize() const {
+	return nbNodes * sizeof(BVHNode) + nbTriangles * (sizeof(Triangle) + sizeof(PlanarShading));
+}
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "lights.h"
+
+#include <algorithm>
+
+Light Light::sphere(const Vec3 &center, Scalar radius, Scalar emitted) {
+	Light light;
+	light.type = SPHERE_LIGHT;
+	light.biface = true;
+	light.p = center;
+	light.radius = radius;
+	light.area = 4. * M_PI * radius * radius;
+	light.power = emitted * light.area;
+	return light;
+}
+
+Light Light::planar(LightType type, const Vec3 &a, const Vec3 &b, const Vec3 &c, bool biface, Scalar emitted) {
+	Light light;
+	light.type = type;
+	light.biface = biface;
+	light.p = a;
+	light.e1 = b - a;
+	light.e2 = c - a;
+	const Vec3 n = cross(light.e1, light.e2);
+	const Scalar len = n.norm();
+	light.normal = n / len;
+	light.radius = 0.;
+	light.area = type == TRIANGLE_LIGHT ? .5 * len : len;
+	light.power = emitted * light.area * (biface ? 2. : 1.);
+	return light;
+}
+
+AABB Light::boundingBox() const {
+	if(type == SPHERE_LIGHT) return AABB(p - Vec3(radius, radius, radius), p + Vec3(radius, radius, radius));
+	Vec3 mini = p, maxi = p;
+	const Vec3 corners[3] = { p + e1, p + e2, p + e1 + e2 };
+	for(uint c = 0; c < (type == QUAD_LIGHT ? 3u : 2u); ++c) {
+		for(uint i = 0; i < 3; ++i) {
+			mini[i] = std::min(mini[i], corners[c][i]);
+			maxi[i] = std::max(maxi[i], corners[c][i]);
+		}
+	}
+	const Vec3 pad(EPS, EPS, EPS);
+	return AABB(mini - pad, maxi + pad);
+}
+
+Scalar Light::generate(Ray &ray, const Vec2 &u) const {
+	if(type == SPHERE_LIGHT) {
+		const Vec3 dir = p - ray.origin;
+		const Scalar dist2 = dir.norm2();
+		if(dist2 <= radius * radius) return 0.;
+		return coneGenerate(std::sqrt(1. - radius * radius / dist2), dir / std::sqrt(dist2), ray, u);
+	}
+	// Uniform on the area, the triangle folding the square along its diagonal
+	Scalar x = u.x, y = u.y;
+	if(type == TRIANGLE_LIGHT) {
+		const Scalar s = std::sqrt(u.x);
+		x = s * (1. - u.y);
+		y = s * u.y;
+	}
+	const Vec3 dir = p + x * e1 + y * e2 - ray.origin;
+	const Scalar dist2 = dir.norm2();
+	ray.direction = dir / std::sqrt(dist2);
+	const Scalar cosLight = std::abs(dot(normal, ray.direction));
+	return cosLight < 1e-8 ? 0. : dist2 / (cosLight * area);
+}
+
+Scalar Light::value(const Ray &ray) const {
+	if(type == SPHERE_LIGHT) {
+		const Vec3 dir = p - ray.origin;
+		const Scalar dist2 = dir.norm2();
+		if(dist2 <= radius * radius) return 0.;
+		return coneValue(std::sqrt(1. - radius * radius / dist2), dir / std::sqrt(dist2), ray);
+	}
+	const Scalar cosLight = dot(normal, ray.direction);
+	if(std::abs(cosLight) < 1e-8) return 0.;
+	const Scalar t = dot(normal, p - ray.origin) / cosLight;
+	if(t <= EPS) return 0.;
+	// Coordinates of the hit along the edges
+	const Vec3 hit = ray.at(t) - p;
+	const Scalar len = type == TRIANGLE_LIGHT ? 2. * area : area;
+	const Scalar x = dot(cross(hit, e2), normal) / len, y = dot(cross(e1, hit), normal) / len;
+	if(x < 0. || y < 0. || (type == TRIANGLE_LIGHT ? x + y > 1. : x > 1. || y > 1.)) return 0.;
+	return t * t / (std::abs(cosLight) * area);
+}
+
+namespace {
+
+// Cosine of the difference of two angles, clamped at 0 when the first one is smaller
+inline Scalar cosSubClamped(Scalar sinA, Scalar cosA, Scalar sinB, Scalar cosB) {
+	return cosA >= cosB ? 1. : cosA * cosB + sinA * sinB;
+}
+
+inline Scalar sinSubClamped(Scalar sinA, Scalar cosA, Scalar sinB, Scalar cosB) {
+	return cosA >= cosB ? 0. : sinA * cosB - cosA * sinB;
+}
+
+inline Scalar sinOf(Scalar cosTheta) { return std::sqrt(std::max(0., 1. - cosTheta * cosTheta)); }
+
+LightNode leafOf(const Light &light, uint index) {
+	LightNode node;
+	node.box = light.boundingBox();
+	node.axis = light.type == SPHERE_LIGHT ? Vec3(0., 1., 0.) : light.normal;
+	node.cosTheta = light.biface ? -1. : 1.;
+	node.sinTheta = 0.;
+	node.power = light.power;
+	node.index = index;
+	node.leaf = true;
+	return node;
+}
+
+// Smallest cone found around the two cones of normals
+void uniteCones(const LightNode &a, const LightNode &b, Vec3 &axis, Scalar &cosTheta) {
+	axis = a.axis;
+	cosTheta = -1.;
+	if(a.cosTheta == -1. || b.cosTheta == -1.) return;
+	const Scalar thetaA = std::acos(a.cosTheta), thetaB = std::acos(b.cosTheta);
+	const Scalar thetaD = std::acos(std::clamp(dot(a.axis, b.axis), -1., 1.));
+	if(std::min(thetaD + thetaB, M_PI) <= thetaA) {
+		cosTheta = a.cosTheta;
+		return;
+	}
+	if(std::min(thetaD + thetaA, M_PI) <= thetaB) {
+		axis = b.axis;
+		cosTheta = b.cosTheta;
+		return;
+	}
+	const Scalar theta = .5 * (thetaA + thetaD + thetaB);
+	const Vec3 normal = cross(a.axis, b.axis);
+	if(theta >= M_PI || normal.norm2() == 0.) return;
+	// Rotation of the axis of a towards the one of b
+	const Scalar rotation = theta - thetaA;
+	axis = std::cos(rotation) * a.axis + std::sin(rotation) * cross(normal.normalized(), a.axis);
+	cosTheta = std::cos(theta);
+}
+
+LightNode unite(const LightNode &a, const LightNode &b) {
+	LightNode node;
+	node.box = a.box;
+	node.box.surround(b.box);
+	uniteCones(a, b, node.axis, node.cosTheta);
+	node.sinTheta = sinOf(node.cosTheta);
+	node.power = a.power + b.power;
+	node.leaf = false;
+	return node;
+}
+
+// Power times the measure of the directions in which the lights emit, times the surface of the node
+Scalar orientationCost(const LightNode &node) {
+	const Scalar thetaO = std::acos(node.cosTheta), thetaW = std::min(thetaO + .5 * M_PI, M_PI);
+	const Scalar sinO = node.sinTheta;
+	const Scalar measure = 2. * M_PI * (1. - node.cosTheta)
+		+ .5 * M_PI * (2. * thetaW * sinO - std::cos(thetaO - 2. * thetaW) - 2. * thetaO * sinO + node.cosTheta);
+	return node.power * measure * node.box.surface();
+}
+
+constexpr int MaxDepth = 64;
+// Past this depth the splits halve the lights, so that the tree of less than 2^32 lights never gets deeper than MaxDepth
+constexpr int MaxSAHDepth = MaxDepth - 32;
+constexpr uint NbBuckets = 12;
+
+}
+
+// The emitted light leaves within a half angle of pi/2 around the normals
+Scalar LightNode::importance(const Vec3 &p, const Vec3 &n) const {
+	const Vec3 center = .5 * (box.min() + box.max());
+	const Scalar radius2 = .25 * (box.max() - box.min()).norm2();
+	const Vec3 toPoint = p - center;
+	const Scalar dist2 = toPoint.norm2();
+	// Point in the bounding sphere of the node: no bound on the angles
+	if(dist2 <= radius2) return power / radius2;
+	const Vec3 w = toPoint / std::sqrt(dist2);
+	const Scalar sin2B = radius2 / dist2, cosB = std::sqrt(1. - sin2B), sinB = std::sqrt(sin2B);
+	Scalar importance = power / dist2;
+	if(cosTheta > -1.) {
+		// Smallest angle between the cone of the normals and the directions from the node towards p
+		const Scalar cosW = dot(axis, w), sinW = sinOf(cosW);
+		const Scalar cosX = cosSubClamped(sinW, cosW, sinTheta, cosTheta), sinX = sinSubClamped(sinW, cosW, sinTheta, cosTheta);
+		const Scalar cosEmitted = cosSubClamped(sinX, cosX, sinB, cosB);
+		if(cosEmitted <= 0.) return 0.;
+		importance *= cosEmitted;
+	}
+	if(n.x != 0. || n.y != 0. || n.z != 0.) {
+		// Smallest angle between the normal of the surface and the directions towards the node
+		const Scalar cosI = - dot(n, w);
+		const Scalar cosReceived = cosSubClamped(sinOf(cosI), cosI, sinB, cosB);
+		if(cosReceived <= 0.) return 0.;
+		importance *= cosReceived;
+	}
+	return importance;
+}
+
+void LightBVH::build() {
+	nodes.clear();
+	if(lights.empty()) return;
+	std::vector<LightNode> leaves(lights.size());
+	for(uint i = 0; i < lights.size(); ++i) leaves[i] = leafOf(lights[i], i);
+	nodes.reserve(2 * lights.size() - 1);
+	build(leaves, 0, leaves.size(), 0);
+}
+
+uint LightBVH::build(std::vector<LightNode> &leaves, uint start, uint end, int depth) {
+	const uint id = nodes.size();
+	if(end - start == 1) {
+		nodes.push_back(leaves[start]);
+		return id;
+	}
+	LightNode node = leaves[start];
+	Vec3 mini = .5 * (node.box.min() + node.box.max()), maxi = mini;
+	for(uint i = start + 1; i < end; ++i) {
+		node = unite(node, leaves[i]);
+		const Vec3 c = .5 * (leaves[i].box.min() + leaves[i].box.max());
+		for(uint k = 0; k < 3; ++k) {
+			mini[k] = std::min(mini[k], c[k]);
+			maxi[k] = std::max(maxi[k], c[k]);
+		}
+	}
+	const Vec3 extent = node.box.max() - node.box.min();
+	const Scalar maxExtent = extent.maxCoeff();
+
+	// Buckets of the centroids along each axis, the split of least cost being kept
+	Scalar bestCost = std::numeric_limits<Scalar>::max();
+	int bestAxis = -1;
+	uint bestSplit = 0;
+	for(uint axis = 0; axis < 3 && depth < MaxSAHDepth; ++axis) {
+		if(maxi[axis] <= mini[axis]) continue;
+		LightNode buckets[NbBuckets];
+		bool filled[NbBuckets] = {};
+		const Scalar scale = NbBuckets / (maxi[axis] - mini[axis]);
+		for(uint i = start; i < end; ++i) {
+			const uint b = std::min(NbBuckets - 1, uint((.5 * (leaves[i].box.min()[axis] + leaves[i].box.max()[axis]) - mini[axis]) * scale));
+			buckets[b] = filled[b] ? unite(buckets[b], leaves[i]) : leaves[i];
+			filled[b] = true;
+		}
+		for(uint split = 1; split < NbBuckets; ++split) {
+			LightNode below, above;
+			bool anyBelow = false, anyAbove = false;
+			for(uint b = 0; b < NbBuckets; ++b) {
+				if(!filled[b]) continue;
+				LightNode &side = b < split ? below : above;
+				bool &any = b < split ? anyBelow : anyAbove;
+				side = any ? unite(side, buckets[b]) : buckets[b];
+				any = true;
+			}
+			if(!anyBelow || !anyAbove) continue;
+			const Scalar cost = (orientationCost(below) + orientationCost(above)) * maxExtent / extent[axis];
+			if(cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	uint middle;
+	if(bestAxis >= 0) {
+		const Scalar scale = NbBuckets / (maxi[bestAxis] - mini[bestAxis]);
+		middle = std::partition(leaves.begin() + start, leaves.begin() + end, [&](const LightNode &leaf) {
+			return std::min(NbBuckets - 1, uint((.5 * (leaf.box.min()[bestAxis] + leaf.box.max()[bestAxis]) - mini[bestAxis]) * scale)) < bestSplit;
+		}) - leaves.begin();
+	} else {
+		// Median of the centroids along their longest axis, past MaxSAHDepth or for lights at the same place
+		const Vec3 spread = maxi - mini;
+		const uint axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : spread.y >= spread.z ? 1 : 2;
+		middle = (start + end) / 2;
+		std::nth_element(leaves.begin() + start, leaves.begin() + middle, leaves.begin() + end, [axis](const LightNode &a, const LightNode &b) {
+			return a.box.min()[axis] + a.box.max()[axis] < b.box.min()[axis] + b.box.max()[axis];
+		});
+	}
+
+	node.index = 0;
+	nodes.push_back(node);
+	build(leaves, start, middle, depth + 1);
+	nodes[id].index = build(leaves, middle, end, depth + 1);
+	return id;
+}
+
+Scalar LightBVH::generate(const Vec3 &normal, Ray &ray, Vec2 u) const {
+	if(nodes.empty() || nodes[0].importance(ray.origin, normal) <= 0.) return 0.;
+	Scalar pdf = 1.;
+	uint n = 0;
+	while(!nodes[n].leaf) {
+		const Scalar left = nodes[n+1].importance(ray.origin, normal), right = nodes[nodes[n].index].importance(ray.origin, normal);
+		if(left + right <= 0.) return 0.;
+		// The sample is rescaled within the chosen child, keeping its stratification
+		const Scalar pLeft = left / (left + right);
+		if(u.x < pLeft) {
+			u.x = std::min(u.x / pLeft, 1. - 0x1p-53);
+			pdf *= pLeft;
+			++ n;
+		} else {
+			u.x = std::min((u.x - pLeft) / (1. - pLeft), 1. - 0x1p-53);
+			pdf *= 1. - pLeft;
+			n = nodes[n].index;
+		}
+	}
+	return pdf * lights[nodes[n].index].generate(ray, u);
+}
+
+Scalar LightBVH::value(const Vec3 &normal, const Ray &ray) const {
+	if(nodes.empty() || nodes[0].importance(ray.origin, normal) <= 0.) return 0.;
+	std::pair<uint, Scalar> stack[MaxDepth + 2];
+	int size = 0;
+	stack[size++] = { 0, 1. };
+	Scalar pdf = 0.;
+	while(size > 0) {
+		const auto [n, probability] = stack[--size];
+		if(nodes[n].leaf) {
+			pdf += probability * lights[nodes[n].index].value(ray);
+			continue;
+		}
+		const uint children[2] = { n+1, nodes[n].index };
+		const Scalar left = nodes[children[0]].importance(ray.origin, normal), right = nodes[children[1]].importance(ray.origin, normal);
+		if(left + right <= 0.) continue;
+		const Scalar importances[2] = { left, right };
+		Scalar t;
+		for(uint c = 0; c < 2; ++c)
+			if(importances[c] > 0. && nodes[children[c]].box.hit(ray, std::numeric_limits<Scalar>::max(), t))
+				stack[size++] = { children[c], probability * importances[c] / (left + right) };
+	}
+	return pdf;
+}
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <array>
+#include <queue>
+
+namespace {
+
+// Symmetric 4x4 matrix of the squared distances to a set of planes
+struct Quadric {
+	Scalar a[10] = {}; // xx xy xz xw yy yz yw zz zw ww
+
+	inline void addPlane(const Vec3 &n, Scalar d) {
+		a[0] += n.x*n.x; a[1] += n.x*n.y; a[2] += n.x*n.z; a[3] += n.x*d;
+		a[4] += n.y*n.y; a[5] += n.y*n.z; a[6] += n.y*d;
+		a[7] += n.z*n.z; a[8] += n.z*d;
+		a[9] += d*d;
+	}
+
+	inline Quadric operator+(const Quadric &other) const {
+		Quadric q;
+		for(uint i = 0; i < 10; ++i) q.a[i] = a[i] + other.a[i];
+		return q;
+	}
+
+	inline Scalar error(const Vec3 &v) const {
+		return a[0]*v.x*v.x + 2.*a[1]*v.x*v.y + 2.*a[2]*v.x*v.z + 2.*a[3]*v.x
+			+ a[4]*v.y*v.y + 2.*a[5]*v.y*v.z + 2.*a[6]*v.y
+			+ a[7]*v.z*v.z + 2.*a[8]*v.z + a[9];
+	}
+
+	// Position minimizing the error, if the system is well conditioned
+	inline bool optimal(Vec3 &v) const {
+		const Scalar c00 = a[4]*a[7] - a[5]*a[5], c01 = a[2]*a[5] - a[1]*a[7], c02 = a[1]*a[5] - a[2]*a[4];
+		const Scalar det = a[0]*c00 + a[1]*c01 + a[2]*c02;
+		const Scalar scale = a[0] + a[4] + a[7];
+		if(std::abs(det) <= 1e-12 * scale*scale*scale) return false;
+		const Scalar c11 = a[0]*a[7] - a[2]*a[2], c12 = a[1]*a[2] - a[0]*a[5], c22 = a[0]*a[4] - a[1]*a[1];
+		v.x = - (c00*a[3] + c01*a[6] + c02*a[8]) / det;
+		v.y = - (c01*a[3] + c11*a[6] + c12*a[8]) / det;
+		v.z = - (c02*a[3] + c12*a[6] + c22*a[8]) / det;
+		return true;
+	}
+};
+
+struct Collapse {
+	Scalar cost;
+	uint v0, v1;
+	Vec3 pos;
+
+	inline bool operator<(const Collapse &other) const { return cost > other.cost; }
+};
+
+class Simplifier {
+public:
+	Simplifier(std::vector<Vec3> &vertices, const std::vector<uint> &indices):
+		vertices(vertices),
+		quadrics(vertices.size()),
+		vertexFaces(vertices.size()),
+		removed(vertices.size(), false) {
+		for(size_t f = 0; f < indices.size() / 3; ++f) {
+			const uint *ids = &indices[3*f];
+			faces.push_back({ ids[0], ids[1], ids[2] });
+			faceAlive.push_back(true);
+			const Vec3 &a = vertices[ids[0]];
+			Vec3 n = cross(vertices[ids[1]] - a, vertices[ids[2]] - a);
+			const Scalar area = n.norm();
+			if(area == 0.) continue;
+			n /= area;
+			Quadric q;
+			q.addPlane(n, -dot(n, a));
+			for(uint k = 0; k < 3; ++k) {
+				for(uint i = 0; i < 10; ++i) quadrics[ids[k]].a[i] += area * q.a[i];
+				vertexFaces[ids[k]].push_back(f);
+			}
+		}
+		nbFaces = faces.size();
+		// Each undirected edge once, boundary ones included
+		std::vector<std::pair<uint, uint>> edges;
+		edges.reserve(3 * faces.size());
+		for(const std::array<uint, 3> &face : faces)
+			for(uint k = 0; k < 3; ++k) edges.push_back(std::minmax(face[k], face[(k+1)%3]));
+		std::sort(edges.begin(), edges.end());
+		edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+		for(const std::pair<uint, uint> &edge : edges) push(edge.first, edge.second);
+	}
+
+	// Collapses the cheapest edges until there are at most target faces left, or no valid collapse
+	void run(size_t target) {
+		while(nbFaces > target && !heap.empty()) {
+			const Collapse c = heap.top();
+			heap.pop();
+			if(removed[c.v0] || removed[c.v1] || flips(c)) continue;
+			apply(c);
+		}
+	}
+
+	std::vector<uint> indices() const {
+		std::vector<uint> indices;
+		indices.reserve(3 * nbFaces);
+		for(size_t f = 0; f < faces.size(); ++f)
+			if(faceAlive[f]) indices.insert(indices.end(), faces[f].begin(), faces[f].end());
+		return indices;
+	}
+
+private:
+	void push(uint v0, uint v1) {
+		const Quadric q = quadrics[v0] + quadrics[v1];
+		Collapse c { 0., v0, v1, Vec3() };
+		if(!q.optimal(c.pos)) {
+			// Best of the end points and the middle
+			c.pos = vertices[v0];
+			for(const Vec3 &p : { vertices[v1], .5 * (vertices[v0] + vertices[v1]) })
+				if(q.error(p) < q.error(c.pos)) c.pos = p;
+		}
+		c.cost = q.error(c.pos);
+		heap.push(c);
+	}
+
+	// Whether moving the faces around the edge to the new position would turn some of them over
+	bool flips(const Collapse &c) const {
+		for(uint v : { c.v0, c.v1 })
+			for(uint f : vertexFaces[v]) {
+				if(!faceAlive[f]) continue;
+				const std::array<uint, 3> &face = faces[f];
+				Vec3 p[3];
+				bool shared = false;
+				for(uint k = 0; k < 3; ++k) {
+					const uint w = face[k];
+					if(w == c.v0 || w == c.v1) {
+						shared |= w != v;
+						p[k] = c.pos;
+					} else p[k] = vertices[w];
+				}
+				if(shared) continue; // removed by the collapse
+				const Vec3 &a = vertices[face[0]];
+				const Vec3 before = cross(vertices[face[1]] - a, vertices[face[2]] - a);
+				const Vec3 after = cross(p[1] - p[0], p[2] - p[0]);
+				if(dot(before, after) <= 0.) return true;
+			}
+		return false;
+	}
+
+	// The two end points are replaced by a new vertex, so that coarser levels leave the finer ones untouched
+	void apply(const Collapse &c) {
+		const uint v = vertices.size();
+		vertices.push_back(c.pos);
+		quadrics.push_back(quadrics[c.v0] + quadrics[c.v1]);
+		removed[c.v0] = removed[c.v1] = true;
+		removed.push_back(false);
+		std::vector<uint> around;
+		for(uint old : { c.v0, c.v1 })
+			for(uint f : vertexFaces[old]) {
+				if(!faceAlive[f]) continue;
+				std::array<uint, 3> &face = faces[f];
+				for(uint &w : face)
+					if(w == c.v0 || w == c.v1) w = v;
+				if(face[0] == face[1] || face[1] == face[2] || face[2] == face[0]) {
+					faceAlive[f] = false;
+					-- nbFaces;
+				} else around.push_back(f);
+			}
+		std::sort(around.begin(), around.end());
+		around.erase(std::unique(around.begin(), around.end()), around.end());
+		vertexFaces.push_back(around);
+		std::vector<uint> neighbours;
+		for(uint f : around)
+			for(uint w : faces[f])
+				if(w != v) neighbours.push_back(w);
+		std::sort(neighbours.begin(), neighbours.end());
+		neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+		for(uint w : neighbours) push(w, v);
+	}
+
+	std::vector<Vec3> &vertices;
+	std::vector<Quadric> quadrics;
+	std::vector<std::vector<uint>> vertexFaces;
+	std::vector<bool> removed;
+	std::vector<std::array<uint, 3>> faces;
+	std::vector<bool> faceAlive;
+	size_t nbFaces;
+	std::priority_queue<Collapse> heap;
+};
+
+}
+
+std::vector<std::vector<uint>> simplifyMesh(std::vector<Vec3> &vertices, const std::vector<uint> &indices, uint nbLevels) {
+	std::vector<std::vector<uint>> levels;
+	Simplifier simplifier(vertices, indices);
+	for(uint l = 1; l < nbLevels; ++l) {
+		simplifier.run((indices.size() / 3) >> l);
+		levels.push_back(simplifier.indices());
+	}
+	return levels;
+}
\ No newline at end of file
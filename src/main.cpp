@@ -1,18 +1,37 @@
 #include "random.h"
-#include "sphere.h"
+#include "scene.h"
+#include "assets.h"
+#include "mesh.h"
 #include "camera.h"
-#include "bvh.h"
-#include "triangle.h"
-#include "medium.h"
+#include "sampler.h"
 #include "stb_image_write.h"
 #include "stats.h"
 
+#include <algorithm>
 #include <iostream>
 #include <thread>
 
-constexpr int SamplesPerPixel = 2345;
+constexpr int SamplesPerPixel = 2048;
+constexpr Scalar AdaptiveThreshold = .01; // error (see PixelEstimate) under which a pixel stops sampling, 0 for SamplesPerPixel everywhere
+constexpr int MinSamplesPerPixel = 64, MaxSamplesPerPixel = 4 * SamplesPerPixel; // bounds of the adaptive sampling
+constexpr bool SampleMap = false; // writes the number of samples of each pixel to samples.png
 constexpr int maxDepth = 40;
+enum Lighting : u_char { MIXTURE, NEXT_EVENT };
+// NEXT_EVENT: each diffuse vertex sends a shadow ray to a light picked by the light BVH, and the path goes on in a direction
+// from the mixture of the samplers placed by hand and the material, both weighted by MIS.
+// MIXTURE: a single direction from the mixture of the samplers, the light BVH and the material.
+constexpr Lighting DirectLighting = NEXT_EVENT;
+constexpr bool PowerHeuristic = true; // of the MIS weights, balance heuristic otherwise
+constexpr SamplerType Sampling = SOBOL; // INDEPENDENT for plain random numbers
+constexpr SamplerType PreviewSampling = BLUE_NOISE; // of the low sample count preview
 constexpr int scene = 1;
+constexpr size_t StreamingBudget = 0; // bytes of mesh chunks kept in memory, 0 to load meshes in memory
+constexpr size_t TextureBudget = 0; // bytes of texture pages kept in memory, 0 to load textures in memory
+constexpr uint LODLevels = 1; // per mesh, 1 to always trace the full mesh
+constexpr bool CompressMeshes = false; // quantized meshes, decoded while tracing, instead of levels of detail
+constexpr bool CompressTextures = false; // block compressed textures, decoded at lookup time
+constexpr bool BakeNoise = false; // noise textures read from a precomputed tile
+constexpr Scalar DiffuseConeSpread = .05; // spread of the ray cones after a diffuse bounce, blurring the textures seen indirectly
 const Vec3 up(0., 1., 0.);
 
 constexpr bool scene_sky[3] { true, false, false };
@@ -23,11 +42,15 @@ const Vec3 skyDiff = skyUp - skyDown;
 constexpr Scalar scene_fog[3] { 1.45e-2, 2.e-5, 2.e-5 };
 constexpr Scalar fogMul = - scene_fog[scene];
 
+// Priority of the emitters sampled through the light BVH, next to the samplers placed by hand, with MIXTURE
+constexpr Scalar scene_lights[3] { .5, 0., 0. };
+Scalar lightPriority = scene_lights[scene];
+
 struct ImportanceSampler {
 	const Scalar priority;
-	std::unique_ptr<const PDF> pdf;
-	ImportanceSampler(const Scalar priority, std::unique_ptr<const PDF> pdf):
-		priority(priority), pdf(pdf.release()) {}
+	const PDF pdf;
+	ImportanceSampler(const Scalar priority, const PDF &pdf):
+		priority(priority), pdf(pdf) {}
 };
 std::vector<ImportanceSampler> samplers;
 Scalar priority_sum = 1.;
@@ -36,55 +59,122 @@ Camera camera;
 int imgWidth, imgHeight;
 
 constexpr Scalar MIN_MULT = 1.e-4;
-void rayColor(const Ray &ray, const Hittable *world, Color &color) {
+// Weight of a sample of pdf a, against a strategy of pdf b for the same direction
+inline Scalar misWeight(Scalar a, Scalar b) {
+	if constexpr(PowerHeuristic) {
+		a *= a;
+		b *= b;
+	}
+	return a / (a + b);
+}
+
+// Returns the number of rays traced
+int rayColor(const Ray &ray, const Scene &world, Sampler &sampler, Color &color) {
 	Vec3 mult(1., 1., 1.);
 	Ray currentRay = ray;
-	int depth = 0;
+	int depth = 0, rays = 0;
 	Scalar tot_dist = 0.;
-	HitRecord record;
-	ScatterRecord scatter;
+	HitRecord record, lightRecord;
+	ScatterRecord scatter, lightScatter;
+	// Pdf of the material sampling of the last diffuse vertex, 0 when its emission is not weighted
+	Scalar lastPdf = 0.;
+	Vec3 lastNormal;
 	rayTrace:
-	if(world->hit(currentRay, std::numeric_limits<Scalar>::max(), record)) {
+	++ rays;
+	if(world.hit(currentRay, std::numeric_limits<Scalar>::max(), record)) {
 		// Compute origin and normal
 		scatter.ray.origin = currentRay.at(record.t);
-		record.normal = record.hittable->getNormal(scatter.ray.origin, currentRay);
+		record.normal = world.getNormal(record, scatter.ray.origin, currentRay);
+		// The ray cone is stretched on the surface, the next ray starts with its width
+		const Scalar coneWidth = record.footprint;
+		record.footprint /= std::max(std::abs(dot(currentRay.direction, record.normal)), .1);
 		// Scatter
-		const bool newRay = record.hittable->scatter(currentRay, record, scatter);
+		sampler.bounce(depth);
+		const Material &material = world.getMaterial(record);
+		const bool newRay = material.scatter(currentRay, record, scatter, sampler);
 		// Update color and mult
 		tot_dist += record.t;
 		const Scalar fogCoeff = std::exp(fogMul * tot_dist);
-		if(scatter.emitted != Vec3(0., 0., 0.)) color += fogCoeff * mult * scatter.emitted;
-		if(!newRay || ++depth >= maxDepth) return;
+		if(scatter.emitted != Vec3(0., 0., 0.)) {
+			const Scalar weight = lastPdf > 0. ? misWeight(lastPdf, world.lights().value(lastNormal, currentRay)) : 1.;
+			color += weight * fogCoeff * mult * scatter.emitted;
+		}
+		if(!newRay || ++depth >= maxDepth) return rays;
 		mult *= scatter.attenuation;
-		if(fogCoeff * mult.maxCoeff() < MIN_MULT) return;
+		if(fogCoeff * mult.maxCoeff() < MIN_MULT) return rays;
 		// Compute new ray
-		if(scatter.isSpecular) currentRay = scatter.ray;
-		else {
+		// Lights are bounded by their cosine with the surface, not in media
+		const Vec3 lightNormal = material.type == ISOTROPIC ? Vec3() : record.normal;
+		if(scatter.isSpecular) {
 			currentRay.origin = scatter.ray.origin;
-			Scalar pr = Random::realRange(0., priority_sum), pdf_val;
+			currentRay.direction = scatter.ray.direction;
+			lastPdf = 0.;
+		} else {
+			if constexpr(DirectLighting == NEXT_EVENT) {
+				// Shadow ray towards a light, whatever emitter it reaches first being weighted against the mixture
+				Ray shadow(scatter.ray.origin, Vec3());
+				shadow.width = coneWidth;
+				shadow.spread = std::max(currentRay.spread, DiffuseConeSpread);
+				if(world.lights().generate(lightNormal, shadow, sampler.get2D()) > 0.) {
+					const Scalar bsdf = material.scattering_pdf(record.normal, shadow);
+					if(bsdf > 0.) {
+						++ rays;
+						if(world.hit(shadow, std::numeric_limits<Scalar>::max(), lightRecord)) {
+							const Material &light = world.getMaterial(lightRecord);
+							lightScatter.ray.origin = shadow.at(lightRecord.t);
+							lightRecord.normal = world.getNormal(lightRecord, lightScatter.ray.origin, shadow);
+							if(light.type == DIFFUSE_LIGHT && !light.scatter(shadow, lightRecord, lightScatter, sampler) && lightScatter.emitted != Vec3(0., 0., 0.)) {
+								const Scalar pdf = world.lights().value(lightNormal, shadow);
+								Scalar mixturePdf = scatter.pdf->value(record.normal, shadow);
+								for(const ImportanceSampler &ip : samplers) mixturePdf += ip.priority * ip.pdf.value(record.normal, shadow);
+								const Scalar weight = misWeight(pdf, mixturePdf / priority_sum);
+								color += (std::exp(fogMul * (tot_dist + lightRecord.t)) * bsdf / pdf * weight) * mult * lightScatter.emitted;
+							}
+						}
+					}
+				}
+			}
+			currentRay.origin = scatter.ray.origin;
+			// Strategies: the samplers, then the light BVH, then the material
+			const int nbSamplers = samplers.size();
+			Vec2 u = sampler.get2D();
+			Scalar pr = u.x * priority_sum, pdf_val;
 			int i = 0;
-			while(i < (int) samplers.size() && pr > samplers[i].priority) pr -= samplers[i++].priority;
-			if(i == (int) samplers.size()) {
-				pdf_val = scatter.pdf->generate(record.normal, currentRay);
-			} else {
-				pdf_val = samplers[i].priority * samplers[i].pdf->generate(record.normal, currentRay);
-				pdf_val += scatter.pdf->value(record.normal, currentRay);
-				for(int j = i+1; j < (int) samplers.size(); ++j) pdf_val += samplers[j].priority * samplers[j].pdf->value(record.normal, currentRay);
+			while(i < nbSamplers && pr > samplers[i].priority) pr -= samplers[i++].priority;
+			if(i == nbSamplers && pr > lightPriority) {
+				pr -= lightPriority;
+				++ i;
+			}
+			// The sample is rescaled within the chosen strategy, keeping its stratification
+			u.x = std::min(1., pr / (i < nbSamplers ? samplers[i].priority : i == nbSamplers ? lightPriority : 1.));
+			if(i < nbSamplers) pdf_val = samplers[i].priority * samplers[i].pdf.generate(record.normal, currentRay, u);
+			else if(i == nbSamplers) {
+				// Only the direction: its pdf sums over all the lights along it
+				if(world.lights().generate(lightNormal, currentRay, u) == 0.) return rays;
+				pdf_val = 0.;
+			} else pdf_val = scatter.pdf->generate(record.normal, currentRay, u);
+			if(i <= nbSamplers) pdf_val += scatter.pdf->value(record.normal, currentRay);
+			if(lightPriority > 0.) pdf_val += lightPriority * world.lights().value(lightNormal, currentRay);
+			for(int j = 0; j < nbSamplers; ++j) if(j != i) pdf_val += samplers[j].priority * samplers[j].pdf.value(record.normal, currentRay);
+			if(pdf_val <= 0.) return rays;
+			mult *= material.scattering_pdf(record.normal, currentRay) * priority_sum / pdf_val;
+			if constexpr(DirectLighting == NEXT_EVENT) {
+				lastPdf = pdf_val / priority_sum;
+				lastNormal = lightNormal;
 			}
-			for(int j = 0; j < i; ++j) pdf_val += samplers[j].priority * samplers[j].pdf->value(record.normal, currentRay);
-			mult *= record.hittable->scattering_pdf(record.normal, currentRay) * priority_sum / pdf_val;
-			if(fogCoeff * mult.maxCoeff() < MIN_MULT) return;
+			if(fogCoeff * mult.maxCoeff() < MIN_MULT) return rays;
+			currentRay.spread = std::max(currentRay.spread, DiffuseConeSpread);
 		}
+		currentRay.width = coneWidth;
 		goto rayTrace;
 	} else if constexpr(sky) {
 		const Scalar t = .5 * (currentRay.direction.y + 1.);
 		color += mult * (skyDown + t * skyDiff);
 	}
+	return rays;
 }
 
-HittableList randomScene(bool bunny = true, bool noisyGround = true) {
-	HittableList world;
-
+void randomScene(Scene &world, bool bunny = true, bool noisyGround = true) {
 	// Camera
 	const Scalar fov = 30.;
 	const Scalar aperture = 0.086;
@@ -94,14 +184,20 @@ HittableList randomScene(bool bunny = true, bool noisyGround = true) {
 	imgWidth = 1280;
 	imgHeight = imgWidth / aspectRatio;
 
+	// Assets first, so that they load while the rest is described
+	AssetLoader assets(world);
+	if(bunny) assets.mesh("../meshes/bunny.obj", Vec3(0., 1, 0.), 90., 2., Vec3(4., .96, 1.),
+								world.addMaterial(Material::metal(Color(.53, .35, .05), .07)));
+	const uint earth = assets.image("../textures/earthmap.jpg");
+
 	// Ground
-	if(noisyGround) world.add(std::make_shared<Sphere>(Vec3(0., -4000., 0.), 4000.,
-								std::make_shared<Lambertian>(std::make_shared<NoiseTexture>(4.))));
-	else world.add(std::make_shared<Sphere>(Vec3(0., -4000., 0.), 4000.,
-						std::make_shared<Lambertian>(std::make_shared<CheckerTexture>(Color(.75, .75, .75), Color(1., .3, .1)))));
+	if(noisyGround) world.add(Sphere(Vec3(0., -4000., 0.), 4000.,
+								world.addMaterial(Material::lambertian(world.addNoise(4.)))));
+	else world.add(Sphere(Vec3(0., -4000., 0.), 4000.,
+						world.addMaterial(Material::lambertian(world.addTexture(Texture::checker(Color(.75, .75, .75), Color(1., .3, .1)))))));
 
 	// Grid of spheres
-	std::shared_ptr<Material> glassMat = std::make_shared<Dielectric>(1.5);
+	const uint glassMat = world.addMaterial(Material::dielectric(1.5));
 	for(int x = -10; x <= 9; ++x) {
 		for(int z = -8; z <= 4; ++z) {
 			Vec3 center(x + .66 * Random::real(), .2, z + .66 * Random::real());
@@ -112,36 +208,30 @@ HittableList randomScene(bool bunny = true, bool noisyGround = true) {
 				if((center - Vec3(0., .95, 0.)).norm2() < 1.33) continue;
 				if((center - Vec3(-4., 1., 0.)).norm2() < 1.44) continue;
 			}
-			std::shared_ptr<Material> mat;
+			uint mat;
 			Scalar rand_mat = Random::real();
-			if(rand_mat < .5) mat = std::make_shared<Lambertian>(Color::random() * Color::random());
-			else if(rand_mat < .8) mat = std::make_shared<Metal>(Color::randomRange(.5, 1.), Random::realRange(0., 0.5));
-			else if(rand_mat < .9) mat = std::make_shared<DiffuseLight>(Color::randomRange(.5, 2.5));
+			if(rand_mat < .5) mat = world.addMaterial(Material::lambertian(world.addTexture(Color::random() * Color::random())));
+			else if(rand_mat < .8) mat = world.addMaterial(Material::metal(Color::randomRange(.5, 1.), Random::realRange(0., 0.5)));
+			else if(rand_mat < .9) mat = world.addMaterial(Material::diffuseLight(world.addTexture(Color::randomRange(.5, 2.5))));
 			else mat = glassMat;
-			world.add(std::make_shared<Sphere>(center, .2, mat));
+			world.add(Sphere(center, .2, mat));
 		}
 	}
 
-	// Big spheres or Bunny
-	if(bunny) loadOBJ("../meshes/bunny.obj", world, Vec3(0., 1, 0.), 90., 2., Vec3(4., .96, 1.),
-								std::make_shared<Metal>(Color(.53, .35, .05), .07));
-	else {
-		world.add(std::make_shared<Sphere>(Vec3(-4., 1., 0.), 1., std::make_shared<Lambertian>(Vec3(.4, .2, .1))));
-		world.add(std::make_shared<Sphere>(Vec3(0., .95, 0.), .95, std::make_shared<Dielectric>(1.5)));
-		world.add(std::make_shared<Sphere>(Vec3(0., .95, 0.), .75, std::make_shared<Dielectric>(1.5), true));
-		world.add(std::make_shared<Sphere>(Vec3(4., .9, 0.), .9, std::make_shared<Metal>(Vec3(.7, .6, .5), 0.)));
+	// Big spheres, unless the bunny is there
+	if(!bunny) {
+		world.add(Sphere(Vec3(-4., 1., 0.), 1., world.addMaterial(Material::lambertian(world.addTexture(Vec3(.4, .2, .1))))));
+		world.add(Sphere(Vec3(0., .95, 0.), .95, world.addMaterial(Material::dielectric(1.5))));
+		world.add(Sphere(Vec3(0., .95, 0.), .75, world.addMaterial(Material::dielectric(1.5)), true));
+		world.add(Sphere(Vec3(4., .9, 0.), .9, world.addMaterial(Material::metal(Vec3(.7, .6, .5), 0.))));
 	}
 
 	// Earth
-	world.add(std::make_shared<Sphere>(Vec3(4., 1.3, 2.7), .5,
-				std::make_shared<Lambertian>(std::make_shared<ImageTexture>("../textures/earthmap.jpg"))));
-	
-	return world;
+	world.add(Sphere(Vec3(4., 1.3, 2.7), .5, world.addMaterial(Material::lambertian(earth))));
+	assets.finish();
 }
 
-HittableList cornellBox() {
-	HittableList world;
-
+void cornellBox(Scene &world) {
 	// Camera
 	const Scalar fov = 40.;
 	const Scalar aperture = 3.;
@@ -151,40 +241,36 @@ HittableList cornellBox() {
 	imgWidth = imgHeight = 720;
 
 	// Materials
-	std::shared_ptr<Material>
-		red = std::make_shared<Lambertian>(Color(.65, .05, .05)),
-		white = std::make_shared<Lambertian>(Color(.73, .73, .73)),
-		green = std::make_shared<Lambertian>(Color(.12, .45, .15)),
-		light = std::make_shared<DiffuseLight>(Color(15., 15., 15.)),
-		aluminium = std::make_shared<Metal>(Color(.8, .85, .88), 0.01),
-		glass = std::make_shared<Dielectric>(1.5);
+	const uint
+		red = world.addMaterial(Material::lambertian(world.addTexture(Color(.65, .05, .05)))),
+		white = world.addMaterial(Material::lambertian(world.addTexture(Color(.73, .73, .73)))),
+		green = world.addMaterial(Material::lambertian(world.addTexture(Color(.12, .45, .15)))),
+		light = world.addMaterial(Material::diffuseLight(world.addTexture(Color(15., 15., 15.)))),
+		aluminium = world.addMaterial(Material::metal(Color(.8, .85, .88), 0.01)),
+		glass = world.addMaterial(Material::dielectric(1.5));
 	
 	// Scene box
-	world.add(std::make_shared<Quad>(Vec3(555, 0, 0), Vec3(555, 0, 555), Vec3(555, 555, 0), green));
-	world.add(std::make_shared<Quad>(Vec3(0, 0, 0), Vec3(0, 555, 0), Vec3(0, 0, 555), red));
-	world.add(std::make_shared<Quad>(Vec3(0, 555, 555), Vec3(555, 555, 555), Vec3(0, 0, 555), white));
-	world.add(std::make_shared<Quad>(Vec3(0, 0, 0), Vec3(0, 0, 555), Vec3(555, 0, 0), white));
-	world.add(std::make_shared<Quad>(Vec3(0, 555, 0), Vec3(555, 555, 0), Vec3(0, 555, 555), white));
+	world.addQuad(Vec3(555, 0, 0), Vec3(555, 0, 555), Vec3(555, 555, 0), green);
+	world.addQuad(Vec3(0, 0, 0), Vec3(0, 555, 0), Vec3(0, 0, 555), red);
+	world.addQuad(Vec3(0, 555, 555), Vec3(555, 555, 555), Vec3(0, 0, 555), white);
+	world.addQuad(Vec3(0, 0, 0), Vec3(0, 0, 555), Vec3(555, 0, 0), white);
+	world.addQuad(Vec3(0, 555, 0), Vec3(555, 555, 0), Vec3(0, 555, 555), white);
 
 	// Light
-	world.add(std::make_shared<Quad>(Vec3(213, 554, 227), Vec3(343, 554, 227), Vec3(213, 554, 332), light));
-	samplers.emplace_back(.6, std::make_unique<TargetCosinePDF>(Vec3(278., 554., 279.5), 80.));
+	world.addQuad(Vec3(213, 554, 227), Vec3(343, 554, 227), Vec3(213, 554, 332), light);
+	samplers.emplace_back(.6, PDF::targetCosine(Vec3(278., 554., 279.5), 80.));
 
 	// Inside boxes
 	const Vec3 spherePos(190., 90., 190.);
 	const Scalar sphereRad = 90.;
-	world.add(std::make_shared<Sphere>(spherePos, sphereRad, glass));
-	// samplers.emplace_back(.1, std::make_unique<TargetConePDF>(spherePos, sphereRad));
+	world.add(Sphere(spherePos, sphereRad, glass));
+	// samplers.emplace_back(.1, PDF::targetCone(spherePos, sphereRad));
 	addBoxRotY(world, Vec3(165., 330., 165.), Vec3(265., 0., 295.), -15., aluminium);
-	samplers.emplace_back(.3, std::make_unique<TargetCosinePDF>(Vec3(366., 165., 353.), 110.));
+	samplers.emplace_back(.3, PDF::targetCosine(Vec3(366., 165., 353.), 110.));
 	// addBoxRotY(world, Vec3(165., 165., 165.), Vec3(130., 0., 65.), 18., white);
-	
-	return world;
 }
 
-HittableList nextWeekScene() {
-	HittableList world;
-
+void nextWeekScene(Scene &world) {
 	// Camera
 	const Scalar fov = 40.;
 	const Scalar aperture = 3.;
@@ -195,9 +281,15 @@ HittableList nextWeekScene() {
 	imgWidth = 720;
 	imgHeight = imgWidth / aspectRatio;
 
+	// Assets first, so that they load while the rest is described
+	AssetLoader assets(world);
+	assets.mesh("../meshes/bunny.obj", up, 180., 140., Vec3(60., 175.336, 250.),
+								world.addMaterial(Material::metal(Color(.53, .35, .05), .07)));
+	const uint earth = assets.image("../textures/earthmap.jpg");
+
 	// Ground
-	std::shared_ptr<Material> groundMat = std::make_shared<Lambertian>(Color(.48, .83, .53));
-	std::shared_ptr<Material> glassMat = std::make_shared<Dielectric>(1.5);
+	const uint groundMat = world.addMaterial(Material::lambertian(world.addTexture(Color(.48, .83, .53))));
+	const uint glassMat = world.addMaterial(Material::dielectric(1.5));
 	const Scalar boxWidth = 100.;
 	for(int i = -5; i < 8; ++i) {
 		for(int j = -2; j < 7; ++j) {
@@ -210,146 +302,256 @@ HittableList nextWeekScene() {
 	addBoxRotY(world, Vec3(.999*boxWidth, 106., .999*boxWidth), Vec3(.0005*boxWidth, 0., boxWidth * 2.0005), 0., glassMat);
 	const Vec3 lightSpherePos(50., 50., 250.);
 	const Scalar lightSphereRad = 25.;
-	world.add(std::make_shared<Sphere>(lightSpherePos, lightSphereRad,
-								std::make_shared<DiffuseLight>(Color(2., 2., 2.))));
-	samplers.emplace_back(.1, std::make_unique<TargetConePDF>(lightSpherePos, lightSphereRad));
-
-	// Bunny
-	HittableList bunny;
-	loadOBJ("../meshes/bunny.obj", bunny, up, 180., 140., Vec3(60., 175.336, 250.),
-								std::make_shared<Metal>(Color(.53, .35, .05), .07));
-	world.add(std::make_shared<BVHNode>(bunny));
+	world.add(Sphere(lightSpherePos, lightSphereRad,
+								world.addMaterial(Material::diffuseLight(world.addTexture(Color(2., 2., 2.))))));
+	samplers.emplace_back(.1, PDF::targetCone(lightSpherePos, lightSphereRad));
 
 	// Light
-	world.add(std::make_shared<Quad>(Vec3(123, 554, 147), Vec3(423, 554, 147), Vec3(113, 554, 412),
-								std::make_shared<DiffuseLight>(Color(7., 7., 7.))));
-	samplers.emplace_back(.6, std::make_unique<TargetCosinePDF>(Vec3(273., 554., 279.5), 200.));
+	world.addQuad(Vec3(123, 554, 147), Vec3(423, 554, 147), Vec3(113, 554, 412),
+								world.addMaterial(Material::diffuseLight(world.addTexture(Color(7., 7., 7.)))));
+	samplers.emplace_back(.6, PDF::targetCosine(Vec3(273., 554., 279.5), 200.));
 	
 	// Some spheres
 	const Vec3 glassSpherePos(260., 150., 45.);
 	const Scalar glassSphereRad = 50.;
-	world.add(std::make_shared<Sphere>(glassSpherePos, glassSphereRad, glassMat));
-	samplers.emplace_back(.06, std::make_unique<TargetConePDF>(glassSpherePos, glassSphereRad));
-	world.add(std::make_shared<Sphere>(Vec3(415., 400., 200.), 50.,
-								std::make_shared<Lambertian>(Color(.7, .3, .1))));
-	world.add(std::make_shared<Sphere>(Vec3(0., 150., 145.), 50.,
-								std::make_shared<Metal>(Color(.8, .8, .9), .8)));
-	world.add(std::make_shared<Sphere>(Vec3(400., 200., 400.), 100.,
-								std::make_shared<Lambertian>(std::make_shared<ImageTexture>("../textures/earthmap.jpg"))));
-	world.add(std::make_shared<Sphere>(Vec3(220., 280., 300.), 80.,
-								std::make_shared<Lambertian>(std::make_shared<NoiseTexture>(.1))));
+	world.add(Sphere(glassSpherePos, glassSphereRad, glassMat));
+	samplers.emplace_back(.06, PDF::targetCone(glassSpherePos, glassSphereRad));
+	world.add(Sphere(Vec3(415., 400., 200.), 50.,
+								world.addMaterial(Material::lambertian(world.addTexture(Color(.7, .3, .1))))));
+	world.add(Sphere(Vec3(0., 150., 145.), 50.,
+								world.addMaterial(Material::metal(Color(.8, .8, .9), .8))));
+	world.add(Sphere(Vec3(400., 200., 400.), 100., world.addMaterial(Material::lambertian(earth))));
+	world.add(Sphere(Vec3(220., 280., 300.), 80.,
+								world.addMaterial(Material::lambertian(world.addNoise(.1)))));
 
 	// Medium
 	const Vec3 mediumSpherePos(360., 150., 145.);
 	const Scalar mediumSphereRad = 70.;
-	std::shared_ptr<Hittable> mediumBound = std::make_shared<Sphere>(mediumSpherePos, mediumSphereRad, glassMat);
-	samplers.emplace_back(.04, std::make_unique<TargetConePDF>(mediumSpherePos, mediumSphereRad));
-	world.add(mediumBound);
-	world.add(std::make_shared<ConstantMedium>(mediumBound, .02, Color(.2, .4, .9)));
-	mediumBound = std::make_shared<Sphere>(Vec3(100., 50., 200.), 800., glassMat);
-	world.add(std::make_shared<ConstantMedium>(mediumBound, 7e-5, Color(1., 1., 1.)));
+	PrimitiveRef mediumBound = world.add(Sphere(mediumSpherePos, mediumSphereRad, glassMat));
+	samplers.emplace_back(.04, PDF::targetCone(mediumSpherePos, mediumSphereRad));
+	world.addMedium(mediumBound, .02, Color(.2, .4, .9));
+	mediumBound = world.add(Sphere(Vec3(100., 50., 200.), 800., glassMat), false);
+	world.addMedium(mediumBound, 7e-5, Color(1., 1., 1.));
 
 	// Many balls
-	HittableList ballBox;
-	std::shared_ptr<Material> white = std::make_shared<Lambertian>(Color(.73, .73, .73));
+	const uint white = world.addMaterial(Material::lambertian(world.addTexture(Color(.73, .73, .73))));
 	const int nBalls = 1000;
 	const Scalar angle = -15. * M_PI / 180.;
 	const Scalar co = std::cos(angle), si = std::sin(angle);
 	for(int i = 0; i < nBalls; ++i) {
 		Vec3 r = Vec3::randomRange(0., 165.);
 		if(r.y > 10. && r.y < 158. && std::max(r.x, 165.-r.z) < 135. && std::max(165-r.x, r.z) > 40.) continue;
-		ballBox.add(std::make_shared<Sphere>(Vec3(-100. + r.x*co - r.z*si, 270. + r.y, 395. + r.x*si + r.z*co), 10., white));
+		world.add(Sphere(Vec3(-100. + r.x*co - r.z*si, 270. + r.y, 395. + r.x*si + r.z*co), 10., white));
 	}
-	world.add(std::make_shared<BVHNode>(ballBox));
-	
-	return world;
+	assets.finish();
 }
 
-Hittable *world;
+Scene world;
 u_char *img;
 std::atomic<int> I;
-int spp = 5;
+int spp = 4; // of the preview, a power of two for the blue noise
+SamplerType sampling = PreviewSampling;
+
+// Running estimate of a pixel, with the variance of its luminance (Welford)
+struct PixelEstimate {
+	Color sum;
+	Scalar mean = 0., m2 = 0.;
+	int count = 0, target = 0;
+	long long rays = 0;
+	bool converged = false;
+	inline void add(const Color &color, int sampleRays) {
+		sum += color;
+		rays += sampleRays;
+		const Scalar luminance = .2126 * color.x + .7152 * color.y + .0722 * color.z;
+		const Scalar delta = luminance - mean;
+		mean += delta / ++ count;
+		m2 += delta * (luminance - mean);
+	}
+	// Standard error of the mean, relative to its square root like the error after the gamma of the output
+	inline Scalar relativeError() const { return std::sqrt(m2 / (count * (count - 1.) * std::max(mean, 1e-4))); }
+};
+std::vector<PixelEstimate> estimates;
+bool adaptive;
+int maxSpp;
+
+void writePixel(int i, int j, Color col) {
+	u_char* pix = img + 3 * (i + (imgHeight - 1 - j) * imgWidth);
+	col.x = std::max(1e-4, col.x);
+	col.y = std::max(1e-4, col.y);
+	col.z = std::max(1e-4, col.z);
+	const Scalar mul = std::min(1., 1. / col.maxCoeff());
+	pix[0] = std::pow(.5 * (mul*col.x + std::min(.999, col.x)), 1./2.2) * 256.;
+	pix[1] = std::pow(.5 * (mul*col.y + std::min(.999, col.y)), 1./2.2) * 256.;
+	pix[2] = std::pow(.5 * (mul*col.z + std::min(.999, col.z)), 1./2.2) * 256.;
+}
 
-void work(const int thread_num) {
-	Random::init(thread_num);
-	constexpr Scalar phi = 1.324717957244746026;
-	constexpr Scalar ax = 1. / phi;
-	constexpr Scalar ay = ax*ax;
+// Samples the pixels up to their target
+void work() {
 	const Scalar mulX = 1. / imgWidth;
 	const Scalar mulY = 1. / imgHeight;
+	Sampler sampler(sampling, imgWidth, imgHeight, maxSpp);
 	for(int i = I++; i < imgWidth; i = I++) {
 		for(int j = 0; j < imgHeight; ++j) {
-			Color col(0., 0., 0.);
-			Scalar x = Random::real();
-			Scalar y = Random::real();
-			for(int s = 0; s < spp; ++s) {
-				x += ax;
-				if(x > 1.) x -= 1.;
-				y += ay;
-				if(y > 1.) y -= 1.;
-				rayColor(camera.getRay((i+x) * mulX, (j+y) * mulY), world, col);
+			PixelEstimate &estimate = estimates[i + j * imgWidth];
+			if(estimate.count >= estimate.target) continue;
+			while(estimate.count < estimate.target) {
+				Color col(0., 0., 0.);
+				sampler.start(i, j, estimate.count);
+				const Vec2 offset = sampler.get2D();
+				const int rays = rayColor(camera.getRay((i + offset.x) * mulX, (j + offset.y) * mulY, sampler), world, sampler, col);
+				estimate.add(col, rays);
 			}
-			u_char* pix = img + 3 * (i + (imgHeight - 1 - j) * imgWidth);
-			col /= spp;
-			col.x = std::max(1e-4, col.x);
-			col.y = std::max(1e-4, col.y);
-			col.z = std::max(1e-4, col.z);
-			const Scalar mul = std::min(1., 1. / col.maxCoeff());
-			pix[0] = std::pow(.5 * (mul*col.x + std::min(.999, col.x)), 1./2.2) * 256.;
-			pix[1] = std::pow(.5 * (mul*col.y + std::min(.999, col.y)), 1./2.2) * 256.;
-			pix[2] = std::pow(.5 * (mul*col.z + std::min(.999, col.z)), 1./2.2) * 256.;
+			writePixel(i, j, estimate.sum / estimate.count);
 		}
 	}
 	Stats::aggregateLocalStats();
 }
 
-void render() {
-	auto start = std::chrono::high_resolution_clock::now();
+// After a round, a pixel converges when its error and those of its neighbours are under the threshold,
+// a single pixel estimate being too unreliable (a firefly not drawn yet). The others double their samples,
+// the noisiest tiles first while the budget lasts: the rays that spp samples everywhere would take,
+// so that the time saved on converged pixels goes to the noisy ones. Returns false when no pixel is left to sample.
+bool nextRound() {
+	constexpr int TileSize = 16;
+	Scalar budget = 0.;
+	std::vector<Scalar> errors(estimates.size());
+	for(size_t p = 0; p < estimates.size(); ++p) {
+		budget += (Scalar) spp * estimates[p].rays / estimates[p].count - estimates[p].rays;
+		errors[p] = estimates[p].relativeError();
+	}
+	for(int j = 0; j < imgHeight; ++j) {
+		for(int i = 0; i < imgWidth; ++i) {
+			PixelEstimate &estimate = estimates[i + j * imgWidth];
+			if(estimate.converged) continue;
+			Scalar error = 0.;
+			for(int y = std::max(0, j-1); y <= std::min(imgHeight-1, j+1); ++y)
+				for(int x = std::max(0, i-1); x <= std::min(imgWidth-1, i+1); ++x) error = std::max(error, errors[x + y * imgWidth]);
+			estimate.converged = error < AdaptiveThreshold;
+		}
+	}
+
+	const int tilesX = (imgWidth + TileSize - 1) / TileSize, tilesY = (imgHeight + TileSize - 1) / TileSize;
+	std::vector<std::pair<Scalar, int>> tiles; // highest error of the pixels left, tile
+	for(int t = 0; t < tilesX * tilesY; ++t) {
+		Scalar error = -1.;
+		for(int j = t / tilesX * TileSize; j < std::min(imgHeight, (t / tilesX + 1) * TileSize); ++j)
+			for(int i = t % tilesX * TileSize; i < std::min(imgWidth, (t % tilesX + 1) * TileSize); ++i)
+				if(!estimates[i + j * imgWidth].converged) error = std::max(error, errors[i + j * imgWidth]);
+		if(error >= 0.) tiles.emplace_back(error, t);
+	}
+	std::sort(tiles.begin(), tiles.end(), std::greater<>());
+	bool more = false;
+	for(const auto &[error, t] : tiles) {
+		for(int j = t / tilesX * TileSize; j < std::min(imgHeight, (t / tilesX + 1) * TileSize); ++j) {
+			for(int i = t % tilesX * TileSize; i < std::min(imgWidth, (t % tilesX + 1) * TileSize); ++i) {
+				PixelEstimate &estimate = estimates[i + j * imgWidth];
+				const int extra = std::min(estimate.count, maxSpp - estimate.count);
+				if(estimate.converged || extra <= 0) continue;
+				const Scalar cost = (Scalar) extra * estimate.rays / estimate.count;
+				if(cost > budget) return more;
+				estimate.target += extra;
+				budget -= cost;
+				more = true;
+			}
+		}
+	}
+	return more;
+}
 
+void runThreads() {
 	I = 0;
 	int T = (int) std::thread::hardware_concurrency() - 1;
 	std::vector<std::thread> threads(T);
-	for(int i = 0; i < T; ++i) threads[i] = std::thread(work, i);
-	work(T);
+	for(int i = 0; i < T; ++i) threads[i] = std::thread(work);
+	work();
 	for(int i = 0; i < T; ++i) threads[i].join();
+}
+
+void render() {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	adaptive = AdaptiveThreshold > 0. && spp > MinSamplesPerPixel;
+	maxSpp = adaptive ? std::max(spp, MaxSamplesPerPixel) : spp;
+	estimates.assign(imgWidth * imgHeight, PixelEstimate());
+	for(PixelEstimate &estimate : estimates) estimate.target = adaptive ? MinSamplesPerPixel : spp;
+	runThreads();
+	// Rounds until the pixels converge, reach maxSpp or use up the budget
+	while(adaptive && nextRound()) runThreads();
 
 	auto end = std::chrono::high_resolution_clock::now();
 	auto time = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
 	std::cout << "Time: " << time << " (ms)\n";
+	if(adaptive) {
+		long long total = 0;
+		for(const PixelEstimate &estimate : estimates) total += estimate.count;
+		std::cout << "Samples: " << (Scalar) total / estimates.size() << " per pixel instead of " << spp << "\n";
+	}
 	#ifdef STATS
 	std::cout << "Sphere tests: " << Stats::sphereRayTest << "\n";
 	std::cout << "Triangle tests: " << Stats::triangleRayTest << "\n";
+	std::cout << "Rect tests: " << Stats::rectRayTest << "\n";
+	std::cout << "Oriented box tests: " << Stats::orientedBoxRayTest << "\n";
 	std::cout << "Node tests: " << Stats::nodeRayTest << "\n";
 	std::cout << "HitBox tests: " << Stats::hitBoxTest << "\n";
 	#endif
 }
 
+// Gray levels of the number of samples of each pixel, up to maxSpp
+void writeSampleMap(const char *fileName) {
+	std::vector<u_char> map(imgWidth * imgHeight);
+	for(int j = 0; j < imgHeight; ++j)
+		for(int i = 0; i < imgWidth; ++i)
+			map[i + (imgHeight - 1 - j) * imgWidth] = std::min(255., 256. * estimates[i + j * imgWidth].count / maxSpp);
+	stbi_write_png(fileName, imgWidth, imgHeight, 1, map.data(), 0);
+}
+
 int main() {
 	Random::init(0);
-	HittableList list;
+	if(StreamingBudget > 0) world.setStreamingBudget(StreamingBudget);
+	if(TextureBudget > 0) world.setTextureBudget(TextureBudget);
+	world.setLODLevels(LODLevels);
+	world.setMeshCompression(CompressMeshes);
+	world.setTextureCompression(CompressTextures);
+	world.setNoiseBaking(BakeNoise);
 	switch(scene) {
 	case 0:
-		list = randomScene(false, true);
+		randomScene(world, false, true);
 		break;
 	case 1:
-		list = cornellBox();
+		cornellBox(world);
 		break;
 	default:
-		list = nextWeekScene();
+		nextWeekScene(world);
 		break;
 	}
-	world = new BVHNode(list);
-	// world = new BVHTree(list);
+	world.build();
+	world.selectLOD(camera, imgWidth);
+	camera.setResolution(imgWidth);
+	if(CompressMeshes) {
+		size_t compressedSize, uncompressedSize;
+		world.compressionReport(compressedSize, uncompressedSize);
+		std::cout << "Compressed meshes: " << compressedSize << " bytes instead of " << uncompressedSize << "\n";
+	}
+	if(CompressTextures) {
+		size_t storedSize, uncompressedSize;
+		Scalar psnr;
+		world.textureReport(storedSize, uncompressedSize, psnr);
+		std::cout << "Compressed textures: " << storedSize << " bytes instead of " << uncompressedSize << ", PSNR " << psnr << " dB\n";
+	}
 	img = new u_char[imgWidth * imgHeight * 3];
 	for(const ImportanceSampler &ip : samplers) priority_sum += ip.priority;
+	if(world.lights().empty() || DirectLighting == NEXT_EVENT) lightPriority = 0.;
+	priority_sum += lightPriority;
+	if(!world.lights().empty()) std::cout << "Lights: " << world.lights().size() << "\n";
 
 	render();
 	stbi_write_png("pre.png", imgWidth, imgHeight, 3, img, 0);
 	spp = SamplesPerPixel;
+	sampling = Sampling;
 	render();
 	stbi_write_png("out.png", imgWidth, imgHeight, 3, img, 0);
+	if(SampleMap) writeSampleMap("samples.png");
 
-	delete world;
 	delete[] img;
 
 	return 0;
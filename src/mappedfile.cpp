@@ -0,0 +1,48 @@
+#include "mappedfile.h"
+#include "parallel.h"
+
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &fileName) {
+	const int fd = open(fileName.c_str(), O_RDONLY);
+	if(fd < 0) throw std::runtime_error("Cannot open file " + fileName + "!");
+	struct stat st;
+	if(fstat(fd, &st) < 0) {
+		close(fd);
+		throw std::runtime_error("Cannot stat file " + fileName + "!");
+	}
+	length = st.st_size;
+	if(length > 0) {
+		void *ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(ptr == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Cannot map file " + fileName + "!");
+		}
+		madvise(ptr, length, MADV_SEQUENTIAL);
+		data = static_cast<const char*>(ptr);
+	}
+	close(fd);
+}
+
+MappedFile::~MappedFile() {
+	if(data) munmap(const_cast<char*>(data), length);
+}
+
+uint64_t MappedFile::hash() const {
+	constexpr uint64_t basis = 14695981039346656037ull, prime = 1099511628211ull;
+	const auto fnv = [&](uint64_t h, const char *begin, const char *end) {
+		for(const char *p = begin; p < end; ++p) h = (h ^ (u_char) *p) * prime;
+		return h;
+	};
+	constexpr size_t blockSize = 1 << 20;
+	std::vector<uint64_t> hashes((length + blockSize - 1) / blockSize);
+	parallelFor(hashes.size(), [&](uint, size_t begin, size_t end) {
+		for(size_t b = begin; b < end; ++b)
+			hashes[b] = fnv(basis, data + b * blockSize, data + std::min(length, (b+1) * blockSize));
+	});
+	return fnv(basis, (const char*) hashes.data(), (const char*) (hashes.data() + hashes.size()));
+}
\ No newline at end of file
@@ -0,0 +1,320 @@
+#include "mesh.h"
+#include "scene.h"
+#include "parallel.h"
+#include "mappedfile.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+
+void transformMesh(std::vector<Vec3> &vertices, const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos) {
+	if(vertices.empty()) return;
+	std::vector<AABB> boxes(threadCount(), AABB(vertices[0], vertices[0]));
+	parallelFor(vertices.size(), [&](uint t, size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) boxes[t].surround(AABB(vertices[i], vertices[i]));
+	});
+	AABB box = boxes[0];
+	for(const AABB &b : boxes) box.surround(b);
+
+	const Vec3 boxMid = .5 * (box.min() + box.max());
+	const Scalar scale0 = 1. / (box.max() - box.min()).maxCoeff();
+	const Vec3 z = rotAxis.normalized();
+	Vec3 x = Vec3::random();
+	x = (x - dot(x, z) * z).normalized();
+	const Vec3 y = cross(z, x);
+	angle *= M_PI / 180.;
+	const Scalar co = std::cos(angle), si = std::sin(angle);
+	parallelFor(vertices.size(), [&](uint, size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) {
+			Vec3 &v = vertices[i];
+			v = (v - boxMid) * scale0;
+			const Scalar vx = dot(v, x), vy = dot(v, y);
+			v = pos + scale * (dot(v, z) * z + (vx * co - vy * si) * x + (vx * si + vy * co) * y);
+		}
+	});
+}
+
+std::string cachePath(const std::string &fileName, uint64_t key, const std::string &extension) {
+	const std::filesystem::path source(fileName);
+	return (source.parent_path() / "cache" / (source.filename().string() + "." + std::to_string(key) + extension)).string();
+}
+
+bool createCacheDirectory(const std::string &path) {
+	std::error_code error;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+	return !error;
+}
+
+uint64_t meshKey(uint64_t contentHash, const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos) {
+	// FNV-1a of the content hash and of the transform
+	constexpr uint64_t prime = 1099511628211ull;
+	const Scalar transform[] = { rotAxis.x, rotAxis.y, rotAxis.z, angle, scale, pos.x, pos.y, pos.z };
+	uint64_t key = contentHash;
+	for(const char *p = (const char*) transform; p < (const char*) (transform + 8); ++p) key = (key ^ (u_char) *p) * prime;
+	return key;
+}
+
+namespace {
+
+// Versioned binary mesh: header, then vertices, indices, triangles and BVH nodes, each section aligned on 8 bytes.
+// Faces are in the order of the triangles. The coarser levels of detail follow, each as a level header, triangles and nodes.
+struct MeshCacheHeader {
+	char magic[8];
+	uint32_t version, triangleSize, nodeSize, nbLevels;
+	uint64_t key, nbVertices, nbIndices, nbTriangles, nbNodes;
+};
+
+struct MeshCacheLevel {
+	uint64_t nbTriangles, nbNodes;
+};
+
+constexpr char MeshCacheMagic[8] = "RTMESH";
+constexpr uint32_t MeshCacheVersion = 3;
+
+inline size_t align8(size_t size) { return (size + 7) & ~size_t(7); }
+
+// Levels of detail of the meshes loaded in the scene, 1 when they are not simplified
+inline uint lodLevels(const Scene &scene) { return scene.compressingMeshes() ? 1 : scene.lodLevels(); }
+
+// The cache holds the levels of detail, so its key depends on their number
+inline uint64_t cacheKey(uint64_t key, const Scene &scene) { return (key ^ lodLevels(scene)) * 1099511628211ull; }
+
+// Coarser level of detail of a mesh
+struct LODData {
+	std::vector<Triangle> triangles;
+	std::vector<BVHNode> nodes;
+};
+
+// One cache per key, so that the instances of a file with different transforms or settings do not overwrite each other
+inline std::string cacheName(const std::string &fileName, uint64_t key) { return cachePath(fileName, key, ".cache"); }
+
+void writeMeshCache(const std::string &fileName, uint64_t key, const std::vector<Vec3> &vertices, const std::vector<uint> &indices,
+					const std::vector<Triangle> &triangles, const BVH &bvh, const std::vector<LODData> &levels) {
+	MeshCacheHeader header {};
+	std::memcpy(header.magic, MeshCacheMagic, 8);
+	header.version = MeshCacheVersion;
+	header.triangleSize = sizeof(Triangle);
+	header.nodeSize = sizeof(BVHNode);
+	header.nbLevels = 1 + levels.size();
+	header.key = key;
+	header.nbVertices = vertices.size();
+	header.nbIndices = indices.size();
+	header.nbTriangles = triangles.size();
+	header.nbNodes = bvh.size();
+
+	// Written aside then renamed, so that a concurrent or interrupted run never sees a partial file
+	const std::string tmpName = cacheName(fileName, key) + ".tmp";
+	if(!createCacheDirectory(tmpName)) return;
+	std::ofstream ofs(tmpName, std::ios::binary);
+	if(!ofs) return;
+	const char zeros[8] = {};
+	const auto write = [&](const void *data, size_t size) {
+		ofs.write((const char*) data, size);
+		ofs.write(zeros, align8(size) - size);
+	};
+	write(&header, sizeof(header));
+	write(vertices.data(), vertices.size() * sizeof(Vec3));
+	write(indices.data(), indices.size() * sizeof(uint));
+	write(triangles.data(), triangles.size() * sizeof(Triangle));
+	write(bvh.data(), bvh.size() * sizeof(BVHNode));
+	for(const LODData &level : levels) {
+		const MeshCacheLevel levelHeader { level.triangles.size(), level.nodes.size() };
+		write(&levelHeader, sizeof(levelHeader));
+		write(level.triangles.data(), level.triangles.size() * sizeof(Triangle));
+		write(level.nodes.data(), level.nodes.size() * sizeof(BVHNode));
+	}
+	ofs.close();
+	if(!ofs || std::rename(tmpName.c_str(), cacheName(fileName, key).c_str()) != 0) std::remove(tmpName.c_str());
+}
+
+// Drops the degenerated faces
+void removeDegenerated(const std::vector<Vec3> &vertices, std::vector<uint> &indices) {
+	const size_t nb = indices.size() / 3;
+	std::vector<char> keep(nb);
+	parallelFor(nb, [&](uint, size_t begin, size_t end) {
+		for(size_t f = begin; f < end; ++f) {
+			const uint *ids = &indices[3*f];
+			if(ids[0] >= vertices.size() || ids[1] >= vertices.size() || ids[2] >= vertices.size())
+				throw std::runtime_error("Face index out of range in mesh!");
+			const Vec3 &a = vertices[ids[0]];
+			keep[f] = cross(vertices[ids[1]] - a, vertices[ids[2]] - a).norm2() > 0.;
+		}
+	});
+	size_t kept = 0;
+	for(size_t f = 0; f < nb; ++f)
+		if(keep[f]) {
+			for(uint k = 0; k < 3; ++k) indices[3*kept+k] = indices[3*f+k];
+			++ kept;
+		}
+	indices.resize(3*kept);
+}
+
+// Triangles in the order of the leaves of their BVH, the faces being sorted alike
+void buildTriangles(const std::vector<Vec3> &vertices, std::vector<uint> &indices, std::vector<Triangle> &sorted, BVH &bvh) {
+	const size_t nb = indices.size() / 3;
+	std::vector<Triangle> triangles(nb);
+	std::vector<BVHPrimitive> primitives(nb);
+	parallelFor(nb, [&](uint, size_t begin, size_t end) {
+		for(size_t f = begin; f < end; ++f) {
+			const uint *ids = &indices[3*f];
+			triangles[f] = Triangle(vertices[ids[0]], vertices[ids[1]], vertices[ids[2]]);
+			primitives[f] = { triangles[f].boundingBox(false), { PrimitiveType(TRIANGLE_X + triangles[f].axis()), (uint) f } };
+		}
+	});
+	bvh.build(primitives);
+	sorted.resize(nb);
+	const std::vector<uint> faces = indices;
+	parallelFor(nb, [&](uint, size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) {
+			const uint f = primitives[i].ref.index;
+			sorted[i] = triangles[f];
+			for(uint k = 0; k < 3; ++k) indices[3*i+k] = faces[3*f+k];
+		}
+	});
+}
+
+// Coarser levels of detail, simplified from the faces of the mesh
+std::vector<LODData> buildLevels(std::vector<Vec3> vertices, const std::vector<uint> &indices, uint nbLevels) {
+	std::vector<LODData> levels;
+	if(nbLevels <= 1 || indices.empty()) return levels;
+	for(std::vector<uint> &level : simplifyMesh(vertices, indices, nbLevels)) {
+		removeDegenerated(vertices, level);
+		if(level.empty()) break;
+		Arena arena;
+		BVH bvh(arena);
+		LODData &data = levels.emplace_back();
+		buildTriangles(vertices, level, data.triangles, bvh);
+		data.nodes.assign(bvh.data(), bvh.data() + bvh.size());
+	}
+	return levels;
+}
+
+struct LevelData {
+	const Triangle *triangles;
+	size_t nbTriangles;
+	const BVHNode *nodes;
+	size_t nbNodes;
+};
+
+// Built mesh, whose arrays are kept alive by owner until it is added to the scene
+struct MeshData {
+	std::shared_ptr<const void> owner;
+	const Vec3 *vertices;
+	size_t nbVertices;
+	const uint *indices;
+	const Triangle *triangles;
+	size_t nbTriangles;
+	const BVHNode *nodes;
+	size_t nbNodes;
+	std::vector<LevelData> levels; // coarser ones
+};
+
+// Compressed, or with its levels of detail, as set in the scene
+MeshCommit commitMesh(const MeshData &mesh, const Scene &scene, uint material) {
+	if(scene.compressingMeshes()) return [mesh, material](Scene &scene) {
+		scene.addCompressedMesh(mesh.vertices, mesh.nbVertices, mesh.indices, mesh.nbTriangles, mesh.nodes, mesh.nbNodes, material);
+	};
+	if(scene.lodLevels() <= 1) return [mesh, material](Scene &scene) {
+		scene.addMesh(mesh.triangles, mesh.nbTriangles, mesh.nodes, mesh.nbNodes, material);
+	};
+	return [mesh, material](Scene &scene) {
+		if(mesh.nbTriangles == 0) return;
+		const uint lod = scene.addLODMesh();
+		scene.addLODLevel(lod, mesh.triangles, mesh.nbTriangles, mesh.nodes, mesh.nbNodes, material);
+		for(const LevelData &level : mesh.levels) scene.addLODLevel(lod, level.triangles, level.nbTriangles, level.nodes, level.nbNodes, material);
+	};
+}
+
+}
+
+MeshCommit loadMeshCache(const std::string &fileName, uint64_t key, const Scene &scene, uint material) {
+	if(scene.streaming()) return loadChunks(fileName, key, material);
+	const std::string name = cacheName(fileName, cacheKey(key, scene));
+	if(!std::ifstream(name)) return nullptr;
+	const std::shared_ptr<const MappedFile> file = std::make_shared<const MappedFile>(name);
+	MeshCacheHeader header;
+	if(file->size() < sizeof(header)) return nullptr;
+	std::memcpy(&header, file->begin(), sizeof(header));
+	if(std::memcmp(header.magic, MeshCacheMagic, 8) != 0 || header.version != MeshCacheVersion
+		|| header.triangleSize != sizeof(Triangle) || header.nodeSize != sizeof(BVHNode) || header.key != cacheKey(key, scene)
+		|| header.nbLevels < 1 || header.nbLevels > MaxLODLevels) return nullptr;
+
+	// A stale or truncated file is rebuilt rather than read out of bounds: the sections are checked against what is left of the file,
+	// by division so that no count can overflow, and the nodes against the triangles
+	size_t offset = sizeof(header);
+	bool valid = true;
+	const auto section = [&](uint64_t count, size_t itemSize) {
+		const char *data = file->begin() + offset;
+		if(count > (file->size() - offset) / itemSize) valid = false;
+		else offset = std::min(file->size(), offset + align8(count * itemSize));
+		return data;
+	};
+	const auto validMesh = [&](uint64_t nbTriangles, const BVHNode *nodes, uint64_t nbNodes) {
+		return valid && nbTriangles <= std::numeric_limits<uint>::max() && BVH::valid(nodes, nbNodes, nbTriangles);
+	};
+	const Vec3 *vertices = reinterpret_cast<const Vec3*>(section(header.nbVertices, sizeof(Vec3)));
+	const uint *indices = reinterpret_cast<const uint*>(section(header.nbIndices, sizeof(uint)));
+	const Triangle *triangles = reinterpret_cast<const Triangle*>(section(header.nbTriangles, sizeof(Triangle)));
+	const BVHNode *nodes = reinterpret_cast<const BVHNode*>(section(header.nbNodes, sizeof(BVHNode)));
+	if(!validMesh(header.nbTriangles, nodes, header.nbNodes) || header.nbIndices != 3 * header.nbTriangles) return nullptr;
+	for(uint64_t i = 0; i < header.nbIndices; ++i)
+		if(indices[i] >= header.nbVertices) return nullptr;
+	std::vector<LevelData> levels;
+	for(uint l = 1; l < header.nbLevels; ++l) {
+		MeshCacheLevel level;
+		const char *levelHeader = section(1, sizeof(level));
+		if(!valid) return nullptr;
+		std::memcpy(&level, levelHeader, sizeof(level));
+		const Triangle *levelTriangles = reinterpret_cast<const Triangle*>(section(level.nbTriangles, sizeof(Triangle)));
+		const BVHNode *levelNodes = reinterpret_cast<const BVHNode*>(section(level.nbNodes, sizeof(BVHNode)));
+		if(!validMesh(level.nbTriangles, levelNodes, level.nbNodes)) return nullptr;
+		levels.push_back({ levelTriangles, level.nbTriangles, levelNodes, level.nbNodes });
+	}
+	return commitMesh({ file, vertices, header.nbVertices, indices, triangles, header.nbTriangles, nodes, header.nbNodes, std::move(levels) }, scene, material);
+}
+
+MeshCommit buildMesh(const Scene &scene, std::vector<Vec3> vertices, std::vector<uint> indices, uint material, const std::string &fileName, uint64_t key) {
+	removeDegenerated(vertices, indices);
+	Arena arena;
+	BVH bvh(arena);
+	std::vector<Triangle> sorted;
+	buildTriangles(vertices, indices, sorted, bvh);
+
+	if(scene.streaming()) {
+		writeChunks(fileName, key, sorted, bvh);
+		if(MeshCommit commit = loadChunks(fileName, key, material)) return commit;
+		throw std::runtime_error("Cannot write the chunks of " + fileName + "!");
+	}
+	std::vector<LODData> lods = buildLevels(vertices, indices, lodLevels(scene));
+	writeMeshCache(fileName, cacheKey(key, scene), vertices, indices, sorted, bvh, lods);
+	struct Built {
+		std::vector<Vec3> vertices;
+		std::vector<uint> indices;
+		std::vector<Triangle> triangles;
+		std::vector<BVHNode> nodes;
+		std::vector<LODData> levels;
+	};
+	const std::shared_ptr<const Built> built = std::make_shared<const Built>(Built { std::move(vertices), std::move(indices), std::move(sorted),
+																				std::vector<BVHNode>(bvh.data(), bvh.data() + bvh.size()), std::move(lods) });
+	std::vector<LevelData> levels;
+	for(const LODData &level : built->levels) levels.push_back({ level.triangles.data(), level.triangles.size(), level.nodes.data(), level.nodes.size() });
+	return commitMesh({ built, built->vertices.data(), built->vertices.size(), built->indices.data(), built->triangles.data(), built->triangles.size(),
+						built->nodes.data(), built->nodes.size(), std::move(levels) }, scene, material);
+}
+
+MeshCommit prepareMesh(const std::string &fileName, uint64_t key, const Scene &scene, const MeshSource &source,
+						const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos, uint material) {
+	if(MeshCommit commit = loadMeshCache(fileName, key, scene, material)) return commit;
+	std::vector<Vec3> vertices;
+	std::vector<uint> indices;
+	source(vertices, indices);
+	transformMesh(vertices, rotAxis, angle, scale, pos);
+	return buildMesh(scene, std::move(vertices), std::move(indices), material, fileName, key);
+}
+
+void loadMesh(const std::string &fileName, Scene &scene, MeshParser parse, const Vec3 &rotAxis, Scalar angle, Scalar scale, const Vec3 &pos, uint material) {
+	const MappedFile file(fileName);
+	const MeshSource source = [&](std::vector<Vec3> &vertices, std::vector<uint> &indices) { parse(fileName, file, vertices, indices); };
+	prepareMesh(fileName, meshKey(file.hash(), rotAxis, angle, scale, pos), scene, source, rotAxis, angle, scale, pos, material)(scene);
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "mesh.h"
+#include "mappedfile.h"
+#include "parallel.h"
+#include "parse.h"
+
+namespace {
+
+// Relative indices can only be resolved once the vertices of the previous chunks are counted
+constexpr long RelativeBias = 1l << 62;
+
+// Positions and faces of a line-aligned part of the file.
+// Faces use 0-based indices, or i - RelativeBias for the i-th vertex of the chunk with relative indices.
+struct OBJChunk {
+	std::vector<Vec3> vertices;
+	std::vector<long> faces;
+};
+
+void parseChunk(const char *p, const char *end, OBJChunk &chunk) {
+	std::vector<long> polygon;
+	while(p < end) {
+		skipBlanks(p, end);
+		if(p == end) break;
+		const char *keyword = p;
+		while(p < end && !isBlank(*p) && *p != '\n') ++ p;
+		const size_t length = p - keyword;
+		if(length == 1 && keyword[0] == 'v') {
+			Vec3 &v = chunk.vertices.emplace_back();
+			v.x = parseScalar(p, end);
+			v.y = parseScalar(p, end);
+			v.z = parseScalar(p, end);
+		} else if(length == 1 && keyword[0] == 'f') {
+			polygon.clear();
+			for(skipBlanks(p, end); p < end && *p != '\n'; skipBlanks(p, end)) {
+				long i = parseInteger(p, end);
+				if(i == 0) throw std::runtime_error("Face index 0 in OBJ file!");
+				polygon.push_back(i > 0 ? i-1 : (long) chunk.vertices.size() + i - RelativeBias);
+				// Texture coordinate and normal indices
+				while(p < end && !isBlank(*p) && *p != '\n') ++ p;
+			}
+			if(polygon.size() < 3) throw std::runtime_error("Face with less than 3 vertices in OBJ file!");
+			for(size_t k = 2; k < polygon.size(); ++k) {
+				chunk.faces.push_back(polygon[0]);
+				chunk.faces.push_back(polygon[k-1]);
+				chunk.faces.push_back(polygon[k]);
+			}
+		}
+		// Comments, normals, texture coordinates, groups and materials are skipped
+		skipLine(p, end);
+	}
+}
+
+}
+
+void parseOBJ(const std::string &, const MappedFile &file, std::vector<Vec3> &vertices, std::vector<uint> &indices) {
+	// Chunks end right after a new line
+	const uint T = threadCount();
+	std::vector<const char*> bounds(T+1, file.end());
+	bounds[0] = file.begin();
+	for(uint t = 1; t < T; ++t) {
+		const char *p = std::max(bounds[t-1], file.begin() + t * file.size() / T);
+		while(p > file.begin() && p < file.end() && p[-1] != '\n') ++ p;
+		bounds[t] = p;
+	}
+	std::vector<OBJChunk> chunks(T);
+	parallelFor(T, [&](uint, size_t begin, size_t end) {
+		for(size_t t = begin; t < end; ++t) parseChunk(bounds[t], bounds[t+1], chunks[t]);
+	});
+
+	std::vector<size_t> vertexOffset(T+1, 0), faceOffset(T+1, 0);
+	for(uint t = 0; t < T; ++t) {
+		vertexOffset[t+1] = vertexOffset[t] + chunks[t].vertices.size();
+		faceOffset[t+1] = faceOffset[t] + chunks[t].faces.size();
+	}
+	vertices.resize(vertexOffset[T]);
+	indices.resize(faceOffset[T]);
+	parallelFor(T, [&](uint, size_t begin, size_t end) {
+		for(size_t t = begin; t < end; ++t) {
+			std::copy(chunks[t].vertices.begin(), chunks[t].vertices.end(), vertices.begin() + vertexOffset[t]);
+			for(size_t i = 0; i < chunks[t].faces.size(); ++i) {
+				const long f = chunks[t].faces[i];
+				const long index = f >= 0 ? f : (long) vertexOffset[t] + f + RelativeBias;
+				if(index < 0 || (size_t) index >= vertices.size()) throw std::runtime_error("Face index out of range in OBJ file!");
+				indices[faceOffset[t] + i] = index;
+			}
+			std::vector<Vec3>().swap(chunks[t].vertices);
+			std::vector<long>().swap(chunks[t].faces);
+		}
+	});
+}
\ No newline at end of file
@@ -1,10 +1,9 @@
 #include "pdf.h"
 
-const UniformPDF uniformPDF;
-const PDF* UniformPDF::instance = &uniformPDF;
+const PDF PDF::uniform(UNIFORM, Vec3(), 0.);
+const PDF PDF::lambertian = PDF::cosine(1.);
 
-Vec3 genPhiIndependant(const Vec3 &normal, const Scalar cn) {
-	const Scalar phi = Random::angle();
+Vec3 genPhiIndependant(const Vec3 &normal, const Scalar cn, const Scalar phi) {
 	const Scalar ax = std::abs(normal.x), ay = std::abs(normal.y), az = std::abs(normal.z);
 	if(ax < ay && ax < az) {
 		const Scalar nyz = normal.y*normal.y + normal.z*normal.z;
@@ -36,43 +35,35 @@ Vec3 genPhiIndependant(const Vec3 &normal, const Scalar cn) {
 	}
 }
 
-Scalar CosinePDF::generate(const Vec3 &normal, Ray &ray) const {
+Scalar cosineGenerate(Scalar power, const Vec3 &dir, Ray &ray, const Vec2 &u) {
 	const Scalar pp1 = power + 1.;
-	const Scalar cn = std::pow(Random::real(), 1. / pp1);
-	ray.direction = genPhiIndependant(normal, cn);
+	const Scalar cn = std::pow(u.x, 1. / pp1);
+	ray.direction = genPhiIndependant(dir, cn, 2. * M_PI * u.y);
 	return std::pow(cn, power) * pp1 * (.5 * (1. / M_PI));
 }
 
-Scalar ConePDF::generate(const Vec3 &normal, Ray &ray) const {
-	const Scalar cn = 1. + Random::real() * (cosMax - 1.);
-	ray.direction = genPhiIndependant(normal, cn);
-	return val;
+Scalar coneGenerate(Scalar cosMax, const Vec3 &dir, Ray &ray, const Vec2 &u) {
+	const Scalar cn = 1. + u.x * (cosMax - 1.);
+	ray.direction = genPhiIndependant(dir, cn, 2. * M_PI * u.y);
+	return 1. / (2. * M_PI * (1. - cosMax));
 }
 
-Scalar TargetCosinePDF::value(UNUSUED const Vec3 &normal, const Ray &ray) const {
-	const Vec3 dir = pos - ray.origin;
-	const Scalar dist2 = dir.norm2();
-	const Scalar power = std::min(80., dist2 * powerMul);
-	return CosinePDF(power).value(dir / std::sqrt(dist2), ray);
-}
-
-Scalar TargetCosinePDF::generate(UNUSUED const Vec3 &normal, Ray &ray) const {
-	const Vec3 dir = pos - ray.origin;
-	const Scalar dist2 = dir.norm2();
-	const Scalar power = std::min(80., dist2 * powerMul);
-	return CosinePDF(power).generate(dir / std::sqrt(dist2), ray);
-}
-
-Scalar TargetConePDF::value(UNUSUED const Vec3 &normal, const Ray &ray) const {
-	const Vec3 dir = pos - ray.origin;
-	const Scalar inv_dist2 = 1. / dir.norm2();
-	const Scalar cosMax = 1. / std::sqrt(1. + rad2 * inv_dist2);
-	return ConePDF(cosMax).value(dir * std::sqrt(inv_dist2), ray);
-}
-
-Scalar TargetConePDF::generate(UNUSUED const Vec3 &normal, Ray &ray) const {
-	const Vec3 dir = pos - ray.origin;
-	const Scalar inv_dist2 = 1. / dir.norm2();
-	const Scalar cosMax = 1. / std::sqrt(1. + rad2 * inv_dist2);
-	return ConePDF(cosMax).generate(dir * std::sqrt(inv_dist2), ray);
+Scalar PDF::generate(const Vec3 &normal, Ray &ray, const Vec2 &u) const {
+	switch(type) {
+	case UNIFORM:
+		ray.direction = Vec3::sphere(u);
+		return uniformVal;
+	case COSINE: return cosineGenerate(param, normal, ray, u);
+	case CONE: return coneGenerate(param, normal, ray, u);
+	case TARGET_COSINE: {
+		const Vec3 dir = pos - ray.origin;
+		const Scalar dist2 = dir.norm2();
+		return cosineGenerate(std::min(80., dist2 * param), dir / std::sqrt(dist2), ray, u);
+	}
+	default: {
+		const Vec3 dir = pos - ray.origin;
+		const Scalar inv_dist2 = 1. / dir.norm2();
+		return coneGenerate(1. / std::sqrt(1. + param * inv_dist2), dir * std::sqrt(inv_dist2), ray, u);
+	}
+	}
 }
@@ -0,0 +1,279 @@
+#include "mesh.h"
+#include "mappedfile.h"
+#include "parallel.h"
+#include "parse.h"
+
+#include <atomic>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+enum PLYType : u_char { INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64 };
+constexpr size_t PLYTypeSize[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+constexpr long MaxListSize = 1 << 16; // items of a list property, beyond which the file is taken as malformed
+
+PLYType plyType(const std::string &name) {
+	if(name == "char" || name == "int8") return INT8;
+	if(name == "uchar" || name == "uint8") return UINT8;
+	if(name == "short" || name == "int16") return INT16;
+	if(name == "ushort" || name == "uint16") return UINT16;
+	if(name == "int" || name == "int32") return INT32;
+	if(name == "uint" || name == "uint32") return UINT32;
+	if(name == "float" || name == "float32") return FLOAT32;
+	if(name == "double" || name == "float64") return FLOAT64;
+	throw std::runtime_error("Unknown type " + name + " in PLY file!");
+}
+
+struct PLYProperty {
+	std::string name;
+	PLYType type;
+	bool list;
+	PLYType countType;
+};
+
+struct PLYElement {
+	std::string name;
+	size_t count;
+	std::vector<PLYProperty> properties;
+
+	// Size of a row, or 0 if it contains lists
+	size_t stride() const {
+		size_t size = 0;
+		for(const PLYProperty &property : properties) {
+			if(property.list) return 0;
+			size += PLYTypeSize[property.type];
+		}
+		return size;
+	}
+
+	int find(const std::string &name) const {
+		for(uint i = 0; i < properties.size(); ++i)
+			if(properties[i].name == name) return i;
+		return -1;
+	}
+};
+
+// Binary values, swapped when the file endianness differs from the machine one
+template<typename T>
+inline T readRaw(const char *p, bool swap) {
+	char bytes[sizeof(T)];
+	std::memcpy(bytes, p, sizeof(T));
+	if(swap) std::reverse(bytes, bytes + sizeof(T));
+	T value;
+	std::memcpy(&value, bytes, sizeof(T));
+	return value;
+}
+
+inline Scalar readBinary(const char *p, PLYType type, bool swap) {
+	switch(type) {
+	case INT8: return (int8_t) *p;
+	case UINT8: return (uint8_t) *p;
+	case INT16: return readRaw<int16_t>(p, swap);
+	case UINT16: return readRaw<uint16_t>(p, swap);
+	case INT32: return readRaw<int32_t>(p, swap);
+	case UINT32: return readRaw<uint32_t>(p, swap);
+	case FLOAT32: return readRaw<float>(p, swap);
+	default: return readRaw<double>(p, swap);
+	}
+}
+
+inline long readIndex(const char *p, PLYType type, bool swap) {
+	switch(type) {
+	case INT8: return (int8_t) *p;
+	case UINT8: return (uint8_t) *p;
+	case INT16: return readRaw<int16_t>(p, swap);
+	case UINT16: return readRaw<uint16_t>(p, swap);
+	case INT32: return readRaw<int32_t>(p, swap);
+	case UINT32: return readRaw<uint32_t>(p, swap);
+	default: throw std::runtime_error("Floating point index in PLY file!");
+	}
+}
+
+inline void addPolygon(const std::vector<long> &polygon, std::vector<uint> &indices) {
+	if(polygon.size() < 3) throw std::runtime_error("Face with less than 3 vertices in PLY file!");
+	for(size_t k = 2; k < polygon.size(); ++k) {
+		indices.push_back(polygon[0]);
+		indices.push_back(polygon[k-1]);
+		indices.push_back(polygon[k]);
+	}
+}
+
+// Rows of an element with lists have to be walked one by one
+const char* readBinaryElement(const PLYElement &element, const char *p, const char *end, bool swap,
+								std::vector<Vec3> &vertices, std::vector<uint> &indices) {
+	const bool isVertex = element.name == "vertex", isFace = element.name == "face";
+	int coords[3] = { element.find("x"), element.find("y"), element.find("z") };
+	if(isVertex && (coords[0] < 0 || coords[1] < 0 || coords[2] < 0)) throw std::runtime_error("Missing vertex coordinate in PLY file!");
+	int faceList = isFace ? element.find("vertex_indices") : -1;
+	if(isFace && faceList < 0) faceList = element.find("vertex_index");
+	if(isFace && (faceList < 0 || !element.properties[faceList].list)) throw std::runtime_error("Missing face indices in PLY file!");
+
+	const size_t stride = element.stride();
+	if(stride > 0) {
+		if((size_t) (end - p) / stride < element.count) throw std::runtime_error("Truncated PLY file!");
+		if(isVertex) {
+			size_t offsets[3];
+			for(uint c = 0; c < 3; ++c) {
+				offsets[c] = 0;
+				for(int i = 0; i < coords[c]; ++i) offsets[c] += PLYTypeSize[element.properties[i].type];
+			}
+			const size_t first = vertices.size();
+			vertices.resize(first + element.count);
+			parallelFor(element.count, [&](uint, size_t from, size_t to) {
+				for(size_t v = from; v < to; ++v) {
+					const char *row = p + v * stride;
+					for(uint c = 0; c < 3; ++c) vertices[first + v][c] = readBinary(row + offsets[c], element.properties[coords[c]].type, swap);
+				}
+			});
+		}
+		return p + element.count * stride;
+	}
+
+	// Usual faces: a list of 3 32-bit indices and nothing else, so that the rows have a fixed size and are read in parallel.
+	// Rows of another size fall back to the walk below.
+	if(isFace && element.properties.size() == 1) {
+		const PLYProperty &list = element.properties[0];
+		const size_t countSize = PLYTypeSize[list.countType], rowSize = countSize + 3 * 4;
+		if((list.type == INT32 || list.type == UINT32) && list.countType != FLOAT32 && list.countType != FLOAT64
+			&& (size_t) (end - p) / rowSize >= element.count) {
+			const size_t first = indices.size();
+			indices.resize(first + 3 * element.count);
+			std::atomic<bool> triangles = true;
+			parallelFor(element.count, [&](uint, size_t from, size_t to) {
+				for(size_t f = from; f < to; ++f) {
+					const char *row = p + f * rowSize;
+					if(readIndex(row, list.countType, swap) != 3) {
+						triangles = false;
+						return;
+					}
+					for(uint k = 0; k < 3; ++k) indices[first + 3*f + k] = readRaw<uint32_t>(row + countSize + 4*k, swap);
+				}
+			});
+			if(triangles) return p + element.count * rowSize;
+			indices.resize(first);
+		}
+	}
+
+	std::vector<long> polygon;
+	for(size_t r = 0; r < element.count; ++r) {
+		Vec3 vertex;
+		for(int i = 0; i < (int) element.properties.size(); ++i) {
+			const PLYProperty &property = element.properties[i];
+			if(property.list) {
+				const size_t countSize = PLYTypeSize[property.countType], itemSize = PLYTypeSize[property.type];
+				if(countSize > (size_t) (end - p)) throw std::runtime_error("Truncated PLY file!");
+				const long count = readIndex(p, property.countType, swap);
+				p += countSize;
+				if(count < 0 || (size_t) count * itemSize > (size_t) (end - p)) throw std::runtime_error("Truncated PLY file!");
+				if(i == faceList && count < 3) throw std::runtime_error("Face with less than 3 vertices in PLY file!");
+				if(i == faceList) {
+					polygon.resize(count);
+					for(long k = 0; k < count; ++k) polygon[k] = readIndex(p + k * itemSize, property.type, swap);
+					addPolygon(polygon, indices);
+				}
+				p += count * itemSize;
+			} else {
+				if(PLYTypeSize[property.type] > (size_t) (end - p)) throw std::runtime_error("Truncated PLY file!");
+				if(isVertex)
+					for(uint c = 0; c < 3; ++c)
+						if(i == coords[c]) vertex[c] = readBinary(p, property.type, swap);
+				p += PLYTypeSize[property.type];
+			}
+		}
+		if(isVertex) vertices.push_back(vertex);
+	}
+	return p;
+}
+
+const char* readASCIIElement(const PLYElement &element, const char *p, const char *end,
+								std::vector<Vec3> &vertices, std::vector<uint> &indices) {
+	const bool isVertex = element.name == "vertex", isFace = element.name == "face";
+	int coords[3] = { element.find("x"), element.find("y"), element.find("z") };
+	if(isVertex && (coords[0] < 0 || coords[1] < 0 || coords[2] < 0)) throw std::runtime_error("Missing vertex coordinate in PLY file!");
+	int faceList = isFace ? element.find("vertex_indices") : -1;
+	if(isFace && faceList < 0) faceList = element.find("vertex_index");
+	if(isFace && (faceList < 0 || !element.properties[faceList].list)) throw std::runtime_error("Missing face indices in PLY file!");
+
+	std::vector<long> polygon;
+	for(size_t r = 0; r < element.count; ++r) {
+		Vec3 vertex;
+		for(int i = 0; i < (int) element.properties.size(); ++i) {
+			const PLYProperty &property = element.properties[i];
+			if(property.list) {
+				const long count = parseInteger(p, end);
+				if(count < 0 || count > MaxListSize) throw std::runtime_error("Invalid list size in PLY file!");
+				if(i == faceList && count < 3) throw std::runtime_error("Face with less than 3 vertices in PLY file!");
+				if(i == faceList) polygon.resize(count);
+				for(long k = 0; k < count; ++k) {
+					const Scalar value = parseScalar(p, end);
+					if(i == faceList) polygon[k] = value;
+				}
+				if(i == faceList) addPolygon(polygon, indices);
+			} else {
+				const Scalar value = parseScalar(p, end);
+				if(isVertex)
+					for(uint c = 0; c < 3; ++c)
+						if(i == coords[c]) vertex[c] = value;
+			}
+		}
+		if(isVertex) vertices.push_back(vertex);
+		skipLine(p, end);
+	}
+	return p;
+}
+
+}
+
+void parsePLY(const std::string &fileName, const MappedFile &file, std::vector<Vec3> &vertices, std::vector<uint> &indices) {
+	// Header
+	const char *p = file.begin(), *end = file.end();
+	std::string format;
+	std::vector<PLYElement> elements;
+	bool magic = true;
+	while(true) {
+		if(p == end) throw std::runtime_error("Unterminated header in PLY file!");
+		const char *lineEnd = std::find(p, end, '\n');
+		std::istringstream line(std::string(p, lineEnd));
+		p = lineEnd < end ? lineEnd + 1 : end;
+		std::string word;
+		line >> word;
+		if(magic) {
+			if(word != "ply") throw std::runtime_error(fileName + " is not a PLY file!");
+			magic = false;
+		} else if(word == "format") {
+			line >> format;
+		} else if(word == "element") {
+			PLYElement &element = elements.emplace_back();
+			line >> element.name >> element.count;
+		} else if(word == "property") {
+			if(elements.empty()) throw std::runtime_error("Property outside of an element in PLY file!");
+			PLYProperty &property = elements.back().properties.emplace_back();
+			std::string type;
+			line >> type;
+			property.list = type == "list";
+			if(property.list) {
+				line >> type;
+				property.countType = plyType(type);
+				line >> type;
+			}
+			property.type = plyType(type);
+			line >> property.name;
+		} else if(word == "end_header") break;
+		else if(word != "comment" && word != "obj_info" && !word.empty()) throw std::runtime_error("Unknown word " + word + " in PLY header!");
+	}
+
+	constexpr uint16_t one = 1;
+	const bool littleEndian = *reinterpret_cast<const u_char*>(&one) == 1;
+	bool binary = true, swap = false;
+	if(format == "ascii") binary = false;
+	else if(format == "binary_little_endian") swap = !littleEndian;
+	else if(format == "binary_big_endian") swap = littleEndian;
+	else throw std::runtime_error("Unknown format " + format + " in PLY file!");
+
+	for(const PLYElement &element : elements) {
+		if(element.name == "vertex") vertices.reserve(vertices.size() + element.count);
+		if(element.name == "face") indices.reserve(indices.size() + 3 * element.count);
+		p = binary ? readBinaryElement(element, p, end, swap, vertices, indices) : readASCIIElement(element, p, end, vertices, indices);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include "rect.h"
+
+#include "stats.h"
+
+std::atomic<unsigned long long> Stats::rectRayTest = {0uLL};
+thread_local unsigned long long Stats::localRectRayTest = 0uLL;
+
+static inline int alignedAxis(const Vec3 &e) {
+	if(e.y == 0. && e.z == 0. && e.x != 0.) return 0;
+	if(e.z == 0. && e.x == 0. && e.y != 0.) return 1;
+	if(e.x == 0. && e.y == 0. && e.z != 0.) return 2;
+	return -1;
+}
+
+bool Rect::isAxisAligned(const Vec3 &a, const Vec3 &b, const Vec3 &c) {
+	const int i1 = alignedAxis(b - a), i2 = alignedAxis(c - a);
+	return i1 >= 0 && i2 >= 0 && i1 != i2;
+}
+
+Rect::Rect(const Vec3 &a, const Vec3 &b, const Vec3 &c, bool biface) {
+	const Vec3 e1 = b - a, e2 = c - a;
+	const uint i1 = alignedAxis(e1), i2 = alignedAxis(e2);
+	const uint x = 3 - i1 - i2, y = (x+1) % 3, z = (x+2) % 3;
+	plane = a[x];
+	lo[0] = std::min(a[y], a[y] + e1[y] + e2[y]);
+	hi[0] = std::max(a[y], a[y] + e1[y] + e2[y]);
+	lo[1] = std::min(a[z], a[z] + e1[z] + e2[z]);
+	hi[1] = std::max(a[z], a[z] + e1[z] + e2[z]);
+	flags = x;
+	if(cross(e1, e2)[x] < 0.) flags |= NEGATIVE;
+	if(biface) flags |= BIFACE;
+	if(i1 == z) flags |= SWAP;
+	if(e1[i1] < 0.) flags |= FLIP_U;
+	if(e2[i2] < 0.) flags |= FLIP_V;
+}
+
+AABB Rect::boundingBox() const {
+	const uint x = axis(), y = (x+1) % 3, z = (x+2) % 3;
+	Vec3 mini, maxi;
+	mini[x] = maxi[x] = plane;
+	mini[y] = lo[0];
+	maxi[y] = hi[0];
+	mini[z] = lo[1];
+	maxi[z] = hi[1];
+	const Vec3 pad = (maxi - mini) * 1e-6 + Vec3(.5*EPS, .5*EPS, .5*EPS);
+	return AABB(mini - pad, maxi + pad);
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <array>
+
+namespace {
+
+inline uint32_t reverseBits(uint32_t x) {
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+// Hash whose bits only depend on the lower ones (Laine and Karras, constants of Burley 2020)
+inline uint32_t laineKarras(uint32_t x, uint32_t seed) {
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+// Second Sobol dimension, whose primitive polynomial is x+1, in the reversed bit order of the first one:
+// the reversed point of the reversed index, as the xor of one table entry per byte
+constexpr std::array<uint32_t, 1024> sobolTables() {
+	uint32_t directions[32] = {};
+	directions[0] = 1u << 31;
+	for(uint i = 1; i < 32; ++i) directions[i] = directions[i-1] ^ (directions[i-1] >> 1);
+	std::array<uint32_t, 1024> tables {};
+	for(uint b = 0; b < 4; ++b)
+		for(uint byte = 0; byte < 256; ++byte)
+			for(uint i = 0; i < 8; ++i) {
+				if(!(byte & (1 << i))) continue;
+				uint32_t reversed = 0;
+				for(uint k = 0; k < 32; ++k)
+					if(directions[31 - 8*b - i] & (1u << k)) reversed |= 1u << (31-k);
+				tables[256*b + byte] ^= reversed;
+			}
+	return tables;
+}
+constexpr std::array<uint32_t, 1024> SobolTables = sobolTables();
+
+inline uint32_t reversedSobol(uint32_t reversedIndex) {
+	return SobolTables[reversedIndex & 255] ^ SobolTables[256 + ((reversedIndex >> 8) & 255)]
+		^ SobolTables[512 + ((reversedIndex >> 16) & 255)] ^ SobolTables[768 + (reversedIndex >> 24)];
+}
+
+// Interleaves zeros between the bits
+inline uint64_t spreadBits(uint64_t x) {
+	x &= 0xffffffffull;
+	x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+	x = (x | (x << 8)) & 0x00ff00ff00ff00ffull;
+	x = (x | (x << 4)) & 0x0f0f0f0f0f0f0f0full;
+	x = (x | (x << 2)) & 0x3333333333333333ull;
+	return (x | (x << 1)) & 0x5555555555555555ull;
+}
+
+constexpr u_char DigitPermutations[24][4] = {
+	{0, 1, 2, 3}, {0, 1, 3, 2}, {0, 2, 1, 3}, {0, 2, 3, 1}, {0, 3, 2, 1}, {0, 3, 1, 2},
+	{1, 0, 2, 3}, {1, 0, 3, 2}, {1, 2, 0, 3}, {1, 2, 3, 0}, {1, 3, 2, 0}, {1, 3, 0, 2},
+	{2, 1, 0, 3}, {2, 1, 3, 0}, {2, 0, 1, 3}, {2, 0, 3, 1}, {2, 3, 0, 1}, {2, 3, 1, 0},
+	{3, 1, 2, 0}, {3, 1, 0, 2}, {3, 2, 1, 0}, {3, 2, 0, 1}, {3, 0, 2, 1}, {3, 0, 1, 2}
+};
+
+// Base 4 digit of a Z-order index at the given shift, permuted by a hash of the higher digits
+inline uint64_t permuteDigit(uint64_t zIndex, uint shift, uint64_t salt) {
+	const uint digit = (zIndex >> shift) & 3;
+	const uint permutation = (((((zIndex >> (shift + 2)) ^ salt) * Random::Golden) >> 32) * 24) >> 32;
+	return uint64_t(DigitPermutations[permutation][digit]) << shift;
+}
+
+inline uint ceilLog2(uint x) {
+	uint bits = 0;
+	while((1u << bits) < x) ++bits;
+	return bits;
+}
+
+constexpr Scalar ToUnit = 0x1p-32;
+
+}
+
+Sampler::Sampler(SamplerType type, uint width, uint height, uint spp): type(type), width(width) {
+	log2SPP = ceilLog2(spp);
+	nbDigits = ceilLog2(std::max(width, height));
+	// Scrambling shared by all the pixels
+	Random::setStream(~uint64_t(0), 0);
+	sharedKey = Random::next();
+}
+
+void Sampler::start(uint x, uint y, uint32_t index) {
+	const uint64_t pixel = x + (uint64_t) y * width;
+	if(type == BLUE_NOISE) {
+		pixelKey = sharedKey;
+		const uint64_t z = (spreadBits(y) << 1) | spreadBits(x);
+		if(z != pixelZ) {
+			// The digits of the pixel, from the highest, are permuted once for all its samples
+			pixelZ = z;
+			pixelSeed = Random::hash(sharedKey ^ z);
+			for(uint d = 1; d <= SobolDimensions; ++d) {
+				pixelDigits[d] = 0;
+				for(int i = nbDigits - 1; i >= 0; --i) pixelDigits[d] |= permuteDigit(z, 2*i, sharedKey ^ (0x55555555ull * d));
+				pixelDigits[d] <<= log2SPP;
+			}
+		}
+	} else {
+		// The scrambling of a pixel is the same for all its samples
+		Random::setStream(pixel, 0);
+		pixelKey = Random::next();
+	}
+	Random::setStream(pixel, index+1);
+	reversedIndex = reverseBits(index);
+	dimension = 0;
+}
+
+// Owen scrambling works on reversed bits, in which order the first Sobol dimension is the index itself
+// and the shuffled index is a single hash of the reversed one
+
+uint32_t Sampler::shuffledIndex(uint64_t key) const {
+	if(type != BLUE_NOISE) return laineKarras(reversedIndex, key);
+	// The samples keep the block of the pixel in the Z-order sequence, their order being shuffled by pixel.
+	// A hash in each bit order, so that the pairing of the dimensions can be any permutation, not only a nested one.
+	const uint64_t seed = Random::hash(key ^ pixelSeed);
+	const uint32_t sample = laineKarras(reverseBits(laineKarras(reversedIndex, seed)), seed >> 32) & ((1u << log2SPP) - 1);
+	// Higher bits would only change the points below the precision
+	return reverseBits(pixelDigits[dimension] | sample);
+}
+
+Scalar Sampler::sobol1D() {
+	const uint64_t key = Random::hash(pixelKey + (++ dimension) * Random::Golden);
+	const uint32_t shuffled = shuffledIndex(key);
+	return reverseBits(laineKarras(reverseBits(shuffled), key >> 32)) * ToUnit;
+}
+
+Vec2 Sampler::sobol2D() {
+	const uint64_t key = Random::hash(pixelKey + (++ dimension) * Random::Golden);
+	const uint32_t shuffled = shuffledIndex(key);
+	const uint32_t x = laineKarras(reverseBits(shuffled), key >> 32);
+	const uint32_t y = laineKarras(reversedSobol(shuffled), (key * Random::Golden) >> 32);
+	return Vec2(reverseBits(x) * ToUnit, reverseBits(y) * ToUnit);
+}
\ No newline at end of file
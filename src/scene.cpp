@@ -0,0 +1,474 @@
+#include "scene.h"
+#include "parallel.h"
+#include "camera.h"
+
+Scene::Scene():
+	spheres(&arena), triangles(&arena), quads(&arena), rects(&arena), boxes(&arena),
+	triangleShading(&arena), quadShading(&arena), rectShading(&arena), boxShading(&arena), media(&arena), meshes(&arena), streamed(&arena), lods(&arena), compressed(&arena), visible(&arena),
+	materials(&arena), textures(&arena), noises(&arena), images(&arena), bvh(arena) {}
+
+uint Scene::addTexture(const Texture &texture) {
+	textures.push_back(texture);
+	return textures.size() - 1;
+}
+
+uint Scene::addNoise(Scalar scale) {
+	noises.emplace_back(scale, arena, bakeNoise);
+	return addTexture(Texture::noise(noises.size() - 1));
+}
+
+uint Scene::addImage(const std::string &fileName) {
+	images.push_back(makeImage(fileName, arena));
+	return addTexture(Texture::image(images.size() - 1));
+}
+
+ImageTexture Scene::makeImage(const std::string &fileName, Arena &storage) const {
+	return ImageTexture(fileName, storage, pagedTextures.get(), compressTextures);
+}
+
+uint Scene::reserveImage() {
+	images.emplace_back();
+	return addTexture(Texture::image(images.size() - 1));
+}
+
+void Scene::setImage(uint texture, const ImageTexture &image, std::shared_ptr<Arena> storage) {
+	images[textures[texture].data] = image;
+	imageStorage.push_back(std::move(storage));
+}
+
+uint Scene::addMaterial(const Material &material) {
+	materials.push_back(material);
+	return materials.size() - 1;
+}
+
+PrimitiveRef Scene::add(const Sphere &sphere, bool visible) {
+	const PrimitiveRef ref { SPHERE, (uint) spheres.size() };
+	spheres.push_back(sphere);
+	if(visible) this->visible.push_back(ref);
+	if(visible && emitted(sphere.getMaterial()) > 0.) lightBVH.add(Light::sphere(sphere.getCenter(), sphere.getRadius(), emitted(sphere.getMaterial())));
+	return ref;
+}
+
+PrimitiveRef Scene::addTriangle(const Vec3 &a, const Vec3 &b, const Vec3 &c, uint material, bool biface) {
+	const Triangle &triangle = triangles.emplace_back(a, b, c, biface);
+	triangleShading.push_back({ material });
+	const PrimitiveRef ref { PrimitiveType(TRIANGLE_X + triangle.axis()), (uint) triangles.size() - 1 };
+	visible.push_back(ref);
+	if(emitted(material) > 0.) lightBVH.add(Light::planar(TRIANGLE_LIGHT, a, b, c, biface, emitted(material)));
+	return ref;
+}
+
+void Scene::addTriangles(const Vec3 *vertices, const uint *indices, size_t nbTriangles, uint material, bool biface) {
+	const size_t first = triangles.size(), firstVisible = visible.size();
+	triangles.resize(first + nbTriangles);
+	triangleShading.resize(first + nbTriangles, { material });
+	visible.resize(firstVisible + nbTriangles);
+	parallelFor(nbTriangles, [&](uint, size_t begin, size_t end) {
+		for(size_t i = begin; i < end; ++i) {
+			const uint *ids = indices + 3*i;
+			Triangle &triangle = triangles[first + i];
+			triangle = Triangle(vertices[ids[0]], vertices[ids[1]], vertices[ids[2]], biface);
+			visible[firstVisible + i] = { PrimitiveType(TRIANGLE_X + triangle.axis()), (uint) (first + i) };
+		}
+	});
+	if(emitted(material) > 0.)
+		for(size_t i = 0; i < nbTriangles; ++i) {
+			const uint *ids = indices + 3*i;
+			lightBVH.add(Light::planar(TRIANGLE_LIGHT, vertices[ids[0]], vertices[ids[1]], vertices[ids[2]], biface, emitted(material)));
+		}
+}
+
+void Scene::addMesh(const Triangle *triangles, size_t nbTriangles, const BVHNode *nodes, size_t nbNodes, uint material) {
+	if(nbTriangles == 0) return;
+	const uint first = this->triangles.size();
+	this->triangles.insert(this->triangles.end(), triangles, triangles + nbTriangles);
+	triangleShading.resize(first + nbTriangles, { material });
+	BVHNode *meshNodes = arena.alloc<BVHNode>(nbNodes);
+	std::copy(nodes, nodes + nbNodes, meshNodes);
+	meshes.push_back({ first, (uint) nbTriangles, meshNodes, nbNodes });
+	visible.push_back({ MESH, (uint) meshes.size() - 1 });
+}
+
+void Scene::addStreamedMesh(const BVHNode *nodes, size_t nbNodes, uint firstChunk, uint material) {
+	BVHNode *topNodes = arena.alloc<BVHNode>(nbNodes);
+	std::copy(nodes, nodes + nbNodes, topNodes);
+	streamed.emplace_back(topNodes, firstChunk, material);
+	visible.push_back({ STREAMED, (uint) streamed.size() - 1 });
+}
+
+void Scene::setStreamingBudget(size_t budget) {
+	chunkCache = std::make_unique<ChunkCache>(budget);
+}
+
+void Scene::setLODLevels(uint levels) {
+	nbLODLevels = std::clamp(levels, 1u, MaxLODLevels);
+}
+
+uint Scene::addLODMesh() {
+	lods.push_back({ {}, 0, 0 });
+	visible.push_back({ LOD, (uint) lods.size() - 1 });
+	return lods.size() - 1;
+}
+
+void Scene::addLODLevel(uint mesh, const Triangle *triangles, size_t nbTriangles, const BVHNode *nodes, size_t nbNodes, uint material) {
+	LODMesh &lod = lods[mesh];
+	if(nbTriangles == 0 || lod.nbLevels == MaxLODLevels) return;
+	const uint first = this->triangles.size();
+	this->triangles.insert(this->triangles.end(), triangles, triangles + nbTriangles);
+	triangleShading.resize(first + nbTriangles, { material });
+	BVHNode *levelNodes = arena.alloc<BVHNode>(nbNodes);
+	std::copy(nodes, nodes + nbNodes, levelNodes);
+	lod.levels[lod.nbLevels ++] = { first, (uint) nbTriangles, levelNodes };
+}
+
+void Scene::addCompressedMesh(const Vec3 *vertices, size_t nbVertices, const uint *indices, size_t nbTriangles, const BVHNode *nodes, size_t nbNodes, uint material) {
+	if(nbTriangles == 0) return;
+	compressed.emplace_back(vertices, nbVertices, indices, nbTriangles, nodes, nbNodes, material, arena);
+	visible.push_back({ COMPRESSED, (uint) compressed.size() - 1 });
+}
+
+void Scene::compressionReport(size_t &compressedSize, size_t &uncompressedSize) const {
+	compressedSize = uncompressedSize = 0;
+	for(const CompressedMesh &mesh : compressed) {
+		compressedSize += mesh.size();
+		uncompressedSize += mesh.uncompressedSize();
+	}
+}
+
+void Scene::selectLOD(const Camera &camera, int imgWidth, Scalar trianglesPerPixel) {
+	for(uint i = 0; i < lods.size(); ++i) {
+		LODMesh &lod = lods[i];
+		const AABB box = boundingBox({ LOD, i });
+		const Scalar pixels = camera.projectedArea(.5 * (box.min() + box.max()), .5 * (box.max() - box.min()).norm(), imgWidth);
+		lod.level = 0;
+		while(lod.level+1 < lod.nbLevels && lod.levels[lod.level].nbTriangles > trianglesPerPixel * pixels) ++ lod.level;
+	}
+}
+
+void Scene::setTextureBudget(size_t budget) {
+	pagedTextures = std::make_unique<TextureCache>(budget);
+}
+
+void Scene::textureReport(size_t &storedSize, size_t &uncompressedSize, Scalar &psnr) const {
+	storedSize = uncompressedSize = 0;
+	psnr = std::numeric_limits<Scalar>::infinity();
+	for(const ImageTexture &image : images) {
+		storedSize += image.size();
+		uncompressedSize += image.uncompressedSize();
+		psnr = std::min(psnr, image.psnr());
+	}
+}
+
+PrimitiveRef Scene::addQuad(const Vec3 &a, const Vec3 &b, const Vec3 &c, uint material, bool biface) {
+	if(emitted(material) > 0.) lightBVH.add(Light::planar(QUAD_LIGHT, a, b, c, biface, emitted(material)));
+	if(Rect::isAxisAligned(a, b, c)) {
+		const Rect &rect = rects.emplace_back(a, b, c, biface);
+		rectShading.push_back({ material });
+		const PrimitiveRef ref { PrimitiveType(RECT_X + rect.axis()), (uint) rects.size() - 1 };
+		visible.push_back(ref);
+		return ref;
+	}
+	const Triangle &quad = quads.emplace_back(a, b, c, biface);
+	quadShading.push_back({ material });
+	const PrimitiveRef ref { PrimitiveType(QUAD_X + quad.axis()), (uint) quads.size() - 1 };
+	visible.push_back(ref);
+	return ref;
+}
+
+PrimitiveRef Scene::addBox(const Vec3 &a, const Vec3 &b, const Vec3 &c, const Vec3 &d, uint material, bool biface) {
+	const PrimitiveRef ref { BOX, (uint) boxes.size() };
+	boxes.emplace_back(a, b, c, d, biface);
+	boxShading.push_back({ material });
+	visible.push_back(ref);
+	return ref;
+}
+
+PrimitiveRef Scene::addMedium(PrimitiveRef boundary, Scalar density, const Color &albedo) {
+	const PrimitiveRef ref { MEDIUM, (uint) media.size() };
+	media.emplace_back(boundary, boundingBox(boundary), density, addMaterial(Material::isotropic(albedo)));
+	visible.push_back(ref);
+	return ref;
+}
+
+static inline int arrayOf(PrimitiveType type) {
+	return type == SPHERE ? 0 : type < QUAD_X ? 1 : type < RECT_X ? 2 : type < BOX ? 3 : type == BOX ? 4 : type == MEDIUM ? 5 : type == MESH ? 6 : type == STREAMED ? 7 : type == LOD ? 8 : 9;
+}
+
+// Puts items in the given order, followed by the ones which are not in it.
+// The permutation is applied in place, following its cycles, to avoid a copy in the arena.
+template<typename T>
+static void reorder(Pool<T> &items, std::vector<uint> &order, std::vector<uint> &remap) {
+	remap.assign(items.size(), items.size());
+	for(uint i = 0; i < order.size(); ++i) remap[order[i]] = i;
+	for(uint i = 0; i < items.size(); ++i)
+		if(remap[i] == items.size()) {
+			remap[i] = order.size();
+			order.push_back(i);
+		}
+	std::vector<bool> done(items.size(), false);
+	for(uint i = 0; i < items.size(); ++i) {
+		if(done[i]) continue;
+		T item = items[i];
+		uint j = i;
+		while(order[j] != i) {
+			items[j] = items[order[j]];
+			done[j] = true;
+			j = order[j];
+		}
+		items[j] = item;
+		done[j] = true;
+	}
+}
+
+void Scene::build() {
+	std::vector<BVHPrimitive> primitives;
+	primitives.reserve(visible.size());
+	for(PrimitiveRef ref : visible) primitives.push_back({ boundingBox(ref), ref });
+	bvh.build(primitives);
+
+	std::vector<uint> order[10], remap[10];
+	for(BVHNode &node : bvh) {
+		if(!node.isLeaf()) continue;
+		std::vector<uint> &o = order[arrayOf(node.type)];
+		const uint first = node.index;
+		node.index = o.size();
+		for(uint i = first; i < first + node.count; ++i) o.push_back(primitives[i].ref.index);
+	}
+	reorder(spheres, order[0], remap[0]);
+	reorder(triangles, order[1], remap[1]);
+	reorder(triangleShading, order[1], remap[1]);
+	reorder(quads, order[2], remap[2]);
+	reorder(quadShading, order[2], remap[2]);
+	reorder(rects, order[3], remap[3]);
+	reorder(rectShading, order[3], remap[3]);
+	reorder(boxes, order[4], remap[4]);
+	reorder(boxShading, order[4], remap[4]);
+	reorder(media, order[5], remap[5]);
+	reorder(meshes, order[6], remap[6]);
+	reorder(streamed, order[7], remap[7]);
+	reorder(lods, order[8], remap[8]);
+	reorder(compressed, order[9], remap[9]);
+	for(PrimitiveRef &ref : visible) ref.index = remap[arrayOf(ref.type)][ref.index];
+	for(ConstantMedium &medium : media) medium.boundary.index = remap[arrayOf(medium.boundary.type)][medium.boundary.index];
+
+	// Mesh triangles are in none of the scene leaves, so they kept their relative order at the end of the array
+	for(Mesh &mesh : meshes) mesh.firstTriangle = remap[1][mesh.firstTriangle];
+	for(LODMesh &lod : lods)
+		for(uint l = 0; l < lod.nbLevels; ++l) lod.levels[l].firstTriangle = remap[1][lod.levels[l].firstTriangle];
+	bvh.graft([this](uint i) { return BVHSubtree { meshes[i].nodes, meshes[i].nbNodes, meshes[i].firstTriangle }; });
+	lightBVH.build();
+}
+
+Scalar Scene::emitted(uint material) const {
+	if(materials[material].type != DIFFUSE_LIGHT) return 0.;
+	// Textures other than colors are not averaged, their lights only get a unit power
+	const Texture &texture = textures[materials[material].texture];
+	Color color(1., 1., 1.);
+	if(texture.type == SOLID_COLOR) color = texture.even;
+	else if(texture.type == CHECKER) color = .5 * (texture.even + texture.odd);
+	return .2126 * color.x + .7152 * color.y + .0722 * color.z;
+}
+
+template<typename HitOne>
+static inline bool hitRange(const BVHNode &leaf, Scalar tMax, HitRecord &record, const HitOne &hitOne) {
+	bool anyHit = false;
+	Scalar t;
+	for(uint i = leaf.index; i < leaf.index + leaf.count; ++i)
+		if(hitOne(i, tMax, t)) {
+			record.primitive = { leaf.type, i };
+			record.t = tMax = t;
+			anyHit = true;
+		}
+	return anyHit;
+}
+
+bool Scene::hitLeaf(const BVHNode &leaf, const Ray &ray, Scalar tMax, HitRecord &record) const {
+	switch(leaf.type) {
+	case SPHERE:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { return spheres[i].hit(ray, tMax, t); });
+	case TRIANGLE_X:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { UPDATE_TRIANGLE_STATS return triangles[i].hit<0, false>(ray, tMax, t); });
+	case TRIANGLE_Y:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { UPDATE_TRIANGLE_STATS return triangles[i].hit<1, false>(ray, tMax, t); });
+	case TRIANGLE_Z:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { UPDATE_TRIANGLE_STATS return triangles[i].hit<2, false>(ray, tMax, t); });
+	case QUAD_X:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { UPDATE_TRIANGLE_STATS return quads[i].hit<0, true>(ray, tMax, t); });
+	case QUAD_Y:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { UPDATE_TRIANGLE_STATS return quads[i].hit<1, true>(ray, tMax, t); });
+	case QUAD_Z:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { UPDATE_TRIANGLE_STATS return quads[i].hit<2, true>(ray, tMax, t); });
+	case RECT_X:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { UPDATE_RECT_STATS return rects[i].hit<0>(ray, tMax, t); });
+	case RECT_Y:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { UPDATE_RECT_STATS return rects[i].hit<1>(ray, tMax, t); });
+	case RECT_Z:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { UPDATE_RECT_STATS return rects[i].hit<2>(ray, tMax, t); });
+	case BOX:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { UPDATE_ORIENTED_BOX_STATS return boxes[i].hit(ray, tMax, t); });
+	case STREAMED: {
+		bool anyHit = false;
+		for(uint i = leaf.index; i < leaf.index + leaf.count; ++i)
+			if(streamed[i].hit(*chunkCache, ray, tMax, record)) {
+				record.primitive = { STREAMED, i };
+				tMax = record.t;
+				anyHit = true;
+			}
+		return anyHit;
+	}
+	case COMPRESSED: {
+		bool anyHit = false;
+		for(uint i = leaf.index; i < leaf.index + leaf.count; ++i)
+			if(compressed[i].hit(ray, tMax, record)) {
+				record.primitive = { COMPRESSED, i };
+				tMax = record.t;
+				anyHit = true;
+			}
+		return anyHit;
+	}
+	case LOD: {
+		bool anyHit = false;
+		for(uint i = leaf.index; i < leaf.index + leaf.count; ++i) {
+			const LODMesh &lod = lods[i];
+			const LODLevel &level = lod.levels[lod.level];
+			// Level leaves index its own triangles, which are scene triangles from firstTriangle
+			if(BVH::hit(level.nodes, ray, tMax, record, [&](const BVHNode &levelLeaf, const Ray &ray, Scalar tMax, HitRecord &record) {
+				BVHNode sceneLeaf = levelLeaf;
+				sceneLeaf.index += level.firstTriangle;
+				return hitLeaf(sceneLeaf, ray, tMax, record);
+			})) {
+				tMax = record.t;
+				anyHit = true;
+			}
+		}
+		return anyHit;
+	}
+	default:
+		return hitRange(leaf, tMax, record, [&](uint i, Scalar tMax, Scalar &t) { return media[i].hit(*this, ray, tMax, t); });
+	}
+}
+
+bool Scene::hit(const Ray &ray, Scalar tMax, HitRecord &record) const {
+	if(bvh.empty()) return false;
+	record.scene = this;
+	if(!bvh.hit(ray, tMax, record, [this](const BVHNode &leaf, const Ray &ray, Scalar tMax, HitRecord &record) {
+		return hitLeaf(leaf, ray, tMax, record);
+	})) return false;
+	record.footprint = ray.widthAt(record.t);
+	return true;
+}
+
+bool Scene::hitPrimitive(PrimitiveRef ref, const Ray &ray, Scalar tMax, Scalar &t) const {
+	switch(ref.type) {
+	case SPHERE: return spheres[ref.index].hit(ray, tMax, t);
+	case TRIANGLE_X: return triangles[ref.index].hit<0, false>(ray, tMax, t);
+	case TRIANGLE_Y: return triangles[ref.index].hit<1, false>(ray, tMax, t);
+	case TRIANGLE_Z: return triangles[ref.index].hit<2, false>(ray, tMax, t);
+	case QUAD_X: return quads[ref.index].hit<0, true>(ray, tMax, t);
+	case QUAD_Y: return quads[ref.index].hit<1, true>(ray, tMax, t);
+	case QUAD_Z: return quads[ref.index].hit<2, true>(ray, tMax, t);
+	case RECT_X: return rects[ref.index].hit<0>(ray, tMax, t);
+	case RECT_Y: return rects[ref.index].hit<1>(ray, tMax, t);
+	case RECT_Z: return rects[ref.index].hit<2>(ray, tMax, t);
+	case BOX: return boxes[ref.index].hit(ray, tMax, t);
+	case STREAMED: {
+		HitRecord record;
+		if(!streamed[ref.index].hit(*chunkCache, ray, tMax, record)) return false;
+		t = record.t;
+		return true;
+	}
+	case COMPRESSED: {
+		HitRecord record;
+		if(!compressed[ref.index].hit(ray, tMax, record)) return false;
+		t = record.t;
+		return true;
+	}
+	case LOD: {
+		HitRecord record;
+		if(!hitLeaf({ AABB(), ref.index, 1, LOD }, ray, tMax, record)) return false;
+		t = record.t;
+		return true;
+	}
+	default: return media[ref.index].hit(*this, ray, tMax, t);
+	}
+}
+
+AABB Scene::boundingBox(PrimitiveRef ref) const {
+	switch(ref.type) {
+	case SPHERE: return spheres[ref.index].boundingBox();
+	case RECT_X: case RECT_Y: case RECT_Z: return rects[ref.index].boundingBox();
+	case BOX: return boxes[ref.index].boundingBox();
+	case MEDIUM: return media[ref.index].boundingBox();
+	case MESH: return meshes[ref.index].nodes[0].box;
+	case STREAMED: return streamed[ref.index].boundingBox();
+	case COMPRESSED: return compressed[ref.index].boundingBox();
+	case LOD: {
+		// Collapsed vertices may leave the box of the finest level
+		const LODMesh &lod = lods[ref.index];
+		AABB box = lod.levels[0].nodes[0].box;
+		for(uint l = 1; l < lod.nbLevels; ++l) box.surround(lod.levels[l].nodes[0].box);
+		return box;
+	}
+	default: return planar(ref).boundingBox(ref.type >= QUAD_X);
+	}
+}
+
+Vec3 Scene::getNormal(const HitRecord &record, const Vec3 &pos, const Ray &ray) const {
+	switch(record.primitive.type) {
+	case SPHERE: return spheres[record.primitive.index].getNormal(pos, ray);
+	case RECT_X: case RECT_Y: case RECT_Z: return rects[record.primitive.index].getNormal(pos, ray);
+	case BOX: return boxes[record.primitive.index].getNormal(pos, ray);
+	case STREAMED: return chunkCache->acquire(record.chunk)->triangles[record.element].getNormal(pos, ray);
+	case COMPRESSED: return compressed[record.primitive.index].getNormal(record.element);
+	case MEDIUM: return media[record.primitive.index].getNormal(pos, ray);
+	default: return planar(record.primitive).getNormal(pos, ray);
+	}
+}
+
+Vec2 Scene::getUV(const HitRecord &record, const Vec3 &pos) const {
+	switch(record.primitive.type) {
+	case SPHERE: return spheres[record.primitive.index].getUV(pos, record.normal);
+	case RECT_X: case RECT_Y: case RECT_Z: return rects[record.primitive.index].getUV(pos, record.normal);
+	case BOX: return boxes[record.primitive.index].getUV(pos, record.normal);
+	case STREAMED: return chunkCache->acquire(record.chunk)->triangles[record.element].getUV(pos, record.normal);
+	case COMPRESSED: return compressed[record.primitive.index].getUV(record.element, pos);
+	case MEDIUM: return Vec2(0., 0.);
+	default: return planar(record.primitive).getUV(pos, record.normal);
+	}
+}
+
+Scalar Scene::uvArea(const HitRecord &record, const Vec3 &pos) const {
+	switch(record.primitive.type) {
+	case SPHERE: return spheres[record.primitive.index].uvArea();
+	case RECT_X: case RECT_Y: case RECT_Z: return rects[record.primitive.index].uvArea();
+	case BOX: return boxes[record.primitive.index].uvArea(pos);
+	case STREAMED: return chunkCache->acquire(record.chunk)->triangles[record.element].uvArea();
+	case COMPRESSED: return compressed[record.primitive.index].uvArea(record.element);
+	case MEDIUM: return 1.;
+	default: return planar(record.primitive).uvArea();
+	}
+}
+
+const Material& Scene::getMaterial(const HitRecord &record) const {
+	switch(record.primitive.type) {
+	case SPHERE: return materials[spheres[record.primitive.index].getMaterial()];
+	case MEDIUM: return materials[media[record.primitive.index].getMaterial()];
+	case STREAMED: return materials[streamed[record.primitive.index].getMaterial()];
+	case COMPRESSED: return materials[compressed[record.primitive.index].getMaterial()];
+	default: return materials[shading(record.primitive).material];
+	}
+}
+
+Color Scene::textureValue(uint texture, const HitRecord &record, const Vec3 &p) const {
+	const Texture &tex = textures[texture];
+	switch(tex.type) {
+	case SOLID_COLOR: return tex.even;
+	case CHECKER: return tex.checkerValue(p);
+	case NOISE: return noises[tex.data].value(p, record.footprint);
+	default: {
+		// Ray cone width in texels of the full resolution
+		const ImageTexture &image = images[tex.data];
+		return image.value(getUV(record, p), record.footprint * std::sqrt(image.texels() / uvArea(record, p)));
+	}
+	}
+}
\ No newline at end of file
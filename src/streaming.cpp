@@ -0,0 +1,175 @@
+#include "streaming.h"
+#include "scene.h"
+
+#include <cstring>
+#include <fstream>
+#include <functional>
+
+static void readAt(int fd, void *data, size_t size, uint64_t offset) {
+	char *p = static_cast<char*>(data);
+	while(size > 0) {
+		const ssize_t n = pread(fd, p, size, offset);
+		if(n <= 0) throw std::runtime_error("Cannot read chunk!");
+		p += n;
+		size -= n;
+		offset += n;
+	}
+}
+
+size_t readChunk(int fd, const ChunkEntry &entry, Chunk &chunk) {
+	chunk.nodes.resize(entry.nbNodes);
+	chunk.triangles.resize(entry.nbTriangles);
+	readAt(fd, chunk.nodes.data(), entry.nbNodes * sizeof(BVHNode), entry.offset);
+	readAt(fd, chunk.triangles.data(), entry.nbTriangles * sizeof(Triangle), entry.offset + entry.nbNodes * sizeof(BVHNode));
+	return entry.size();
+}
+
+bool StreamedMesh::hit(ChunkCache &cache, const Ray &ray, Scalar tMax, HitRecord &record) const {
+	return BVH::hit(nodes, ray, tMax, record, [&](const BVHNode &chunkLeaf, const Ray &ray, Scalar tMax, HitRecord &record) {
+		const uint id = firstChunk + chunkLeaf.index;
+		const std::shared_ptr<const Chunk> chunk = cache.acquire(id);
+		const Triangle *triangles = chunk->triangles.data();
+		return BVH::hit(chunk->nodes.data(), ray, tMax, record, [&](const BVHNode &leaf, const Ray &ray, Scalar tMax, HitRecord &record) {
+			bool anyHit = false;
+			Scalar t;
+			for(uint i = leaf.index; i < leaf.index + leaf.count; ++i) {
+				UPDATE_TRIANGLE_STATS
+				bool hit;
+				switch(leaf.type) {
+				case TRIANGLE_X: hit = triangles[i].hit<0, false>(ray, tMax, t); break;
+				case TRIANGLE_Y: hit = triangles[i].hit<1, false>(ray, tMax, t); break;
+				default: hit = triangles[i].hit<2, false>(ray, tMax, t); break;
+				}
+				if(hit) {
+					record.t = tMax = t;
+					record.chunk = id;
+					record.element = i;
+					anyHit = true;
+				}
+			}
+			return anyHit;
+		});
+	});
+}
+
+namespace {
+
+// Versioned chunk file: header, top-level nodes, chunk entries, then the chunks
+struct ChunkFileHeader {
+	char magic[8];
+	uint32_t version, triangleSize, nodeSize, padding;
+	uint64_t key, nbNodes, nbChunks;
+};
+
+constexpr char ChunkFileMagic[8] = "RTCHUNK";
+constexpr uint32_t ChunkFileVersion = 1;
+constexpr uint ChunkTriangles = 1 << 13;
+
+// One chunk file per key, which is reopened when the mesh is added to the scene
+inline std::string chunkName(const std::string &fileName, uint64_t key) { return cachePath(fileName, key, ".chunks"); }
+
+}
+
+void writeChunks(const std::string &fileName, uint64_t key, const std::vector<Triangle> &triangles, const BVH &bvh) {
+	// Triangle range and end of the subtree of each node, children being after their parent
+	const BVHNode *nodes = bvh.data();
+	std::vector<uint> first(bvh.size()), last(bvh.size()), subtreeEnd(bvh.size());
+	for(size_t n = bvh.size(); n-- > 0;) {
+		if(nodes[n].isLeaf()) {
+			first[n] = nodes[n].index;
+			last[n] = nodes[n].index + nodes[n].count;
+			subtreeEnd[n] = n+1;
+		} else {
+			first[n] = first[n+1];
+			last[n] = last[nodes[n].index];
+			subtreeEnd[n] = subtreeEnd[nodes[n].index];
+		}
+	}
+
+	// The top-level BVH stops at the first nodes small enough to be a chunk
+	std::vector<BVHNode> top;
+	std::vector<uint> roots;
+	const std::function<void(uint)> split = [&](uint n) {
+		if(last[n] - first[n] <= ChunkTriangles) {
+			BVHNode &leaf = top.emplace_back(nodes[n]);
+			leaf.index = roots.size();
+			leaf.count = 1;
+			roots.push_back(n);
+			return;
+		}
+		const uint id = top.size();
+		top.push_back(nodes[n]);
+		split(n+1);
+		top[id].index = top.size();
+		split(nodes[n].index);
+	};
+	if(bvh.size() > 0) split(0);
+
+	ChunkFileHeader header {};
+	std::memcpy(header.magic, ChunkFileMagic, 8);
+	header.version = ChunkFileVersion;
+	header.triangleSize = sizeof(Triangle);
+	header.nodeSize = sizeof(BVHNode);
+	header.key = key;
+	header.nbNodes = top.size();
+	header.nbChunks = roots.size();
+	std::vector<ChunkEntry> entries(roots.size());
+	uint64_t offset = sizeof(header) + top.size() * sizeof(BVHNode) + entries.size() * sizeof(ChunkEntry);
+	for(uint c = 0; c < roots.size(); ++c) {
+		entries[c] = { offset, subtreeEnd[roots[c]] - roots[c], last[roots[c]] - first[roots[c]] };
+		offset += entries[c].size();
+	}
+
+	const std::string tmpName = chunkName(fileName, key) + ".tmp";
+	if(!createCacheDirectory(tmpName)) return;
+	std::ofstream ofs(tmpName, std::ios::binary);
+	if(!ofs) return;
+	ofs.write((const char*) &header, sizeof(header));
+	ofs.write((const char*) top.data(), top.size() * sizeof(BVHNode));
+	ofs.write((const char*) entries.data(), entries.size() * sizeof(ChunkEntry));
+	for(uint root : roots) {
+		// Chunk nodes index from the chunk root and its first triangle
+		for(uint n = root; n < subtreeEnd[root]; ++n) {
+			BVHNode node = nodes[n];
+			node.index -= node.isLeaf() ? first[root] : root;
+			ofs.write((const char*) &node, sizeof(node));
+		}
+		ofs.write((const char*) (triangles.data() + first[root]), (last[root] - first[root]) * sizeof(Triangle));
+	}
+	ofs.close();
+	if(!ofs || std::rename(tmpName.c_str(), chunkName(fileName, key).c_str()) != 0) std::remove(tmpName.c_str());
+}
+
+MeshCommit loadChunks(const std::string &fileName, uint64_t key, uint material) {
+	std::ifstream ifs(chunkName(fileName, key), std::ios::binary);
+	ChunkFileHeader header;
+	if(!ifs.read((char*) &header, sizeof(header))) return nullptr;
+	if(std::memcmp(header.magic, ChunkFileMagic, 8) != 0 || header.version != ChunkFileVersion
+		|| header.triangleSize != sizeof(Triangle) || header.nodeSize != sizeof(BVHNode) || header.key != key) return nullptr;
+	// A bad file would only fail once its chunks are paged in while rendering, so it is checked here and rebuilt instead:
+	// the sections against the file size, by division so that no count can overflow, and the nodes of every chunk
+	ifs.seekg(0, std::ios::end);
+	const uint64_t fileSize = ifs.tellg();
+	uint64_t offset = sizeof(header);
+	if(!ifs || header.nbNodes > (fileSize - offset) / sizeof(BVHNode)) return nullptr;
+	offset += header.nbNodes * sizeof(BVHNode);
+	if(header.nbChunks > (fileSize - offset) / sizeof(ChunkEntry)) return nullptr;
+	std::vector<BVHNode> top(header.nbNodes);
+	std::vector<ChunkEntry> entries(header.nbChunks);
+	ifs.seekg(sizeof(header));
+	ifs.read((char*) top.data(), top.size() * sizeof(BVHNode));
+	ifs.read((char*) entries.data(), entries.size() * sizeof(ChunkEntry));
+	if(!ifs || !BVH::valid(top.data(), top.size(), entries.size(), false)) return nullptr;
+	const uint64_t chunksOffset = offset + entries.size() * sizeof(ChunkEntry);
+	std::vector<BVHNode> nodes;
+	for(const ChunkEntry &entry : entries) {
+		if(entry.offset < chunksOffset || entry.offset > fileSize || entry.size() > fileSize - entry.offset) return nullptr;
+		nodes.resize(entry.nbNodes);
+		ifs.seekg(entry.offset);
+		ifs.read((char*) nodes.data(), nodes.size() * sizeof(BVHNode));
+		if(!ifs || !BVH::valid(nodes.data(), nodes.size(), entry.nbTriangles)) return nullptr;
+	}
+	return [fileName, key, top, entries, material](Scene &scene) {
+		if(!top.empty()) scene.addStreamedMesh(top.data(), top.size(), scene.chunks().addFile(chunkName(fileName, key), entries), material);
+	};
+}
\ No newline at end of file
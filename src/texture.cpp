@@ -1,65 +1,408 @@
 #include "texture.h"
-#include "hittable.h"
 
 #include "stb_image.h"
+#include "mappedfile.h"
+#include "parallel.h"
+#include "random.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
 
-NoiseTexture::NoiseTexture(Scalar scale): scale(scale) {
-	vecs = new Vec3[nbVals];
-	for(int i = 0; i < nbVals; ++i) vecs[i] = Vec3::randomSphere();
+namespace {
+
+// Versioned tile file: header, then the tiled levels one after the other
+struct TileFileHeader {
+	char magic[8];
+	uint32_t version, channels, nbLevels, compressed;
+	uint64_t key;
+	double psnr;
+	int32_t widths[16], heights[16];
+};
+
+constexpr char TileFileMagic[8] = "RTTILES";
+constexpr uint32_t TileFileVersion = 2;
+
+// Without SSE4.1, std::floor is a call
+inline int floorInt(Scalar x) {
+	const int i = int(x);
+	return i - (x < i);
+}
+
+inline std::string tileName(const std::string &fileName) { return fileName + ".tiles"; }
+
+inline uint16_t pack565(const Color &c) {
+	const auto quantize = [](Scalar x, int max) { return (uint16_t) std::clamp(std::lround(x * max / 255.), 0l, (long) max); };
+	return (quantize(c.x, 31) << 11) | (quantize(c.y, 63) << 5) | quantize(c.z, 31);
+}
+
+void writeTileFile(const std::string &fileName, const TileFileHeader &header, const std::vector<std::vector<u_char>> &tiled) {
+	// Written aside then renamed, so that a concurrent or interrupted run never sees a partial file
+	const std::string tmpName = tileName(fileName) + ".tmp";
+	std::ofstream ofs(tmpName, std::ios::binary);
+	if(!ofs) return;
+	ofs.write((const char*) &header, sizeof(header));
+	for(const std::vector<u_char> &level : tiled) ofs.write((const char*) level.data(), level.size());
+	ofs.close();
+	if(!ofs || std::rename(tmpName.c_str(), tileName(fileName).c_str()) != 0) std::remove(tmpName.c_str());
+}
+
+// Spreads the bits of x on the even bits
+inline uint32_t spreadBits(uint32_t x) {
+	x = (x | (x << 8)) & 0x00ff00ffu;
+	x = (x | (x << 4)) & 0x0f0f0f0fu;
+	x = (x | (x << 2)) & 0x33333333u;
+	return (x | (x << 1)) & 0x55555555u;
+}
+
+// Bits of the Morton index of the tiled storage coming from one coordinate, up to the padded size.
+// On a grid of 2^bits x 2^otherBits tiles, the common low bits are interleaved and the remaining ones of the longest side come on top.
+uint32_t* mortonBits(int size, uint tileBits, uint bits, uint otherBits, uint shift, Arena &arena) {
+	size = std::max(size, int(1 << (bits + tileBits)));
+	uint32_t *table = arena.alloc<uint32_t>(size);
+	const uint common = std::min(bits, otherBits), mask = (1u << common) - 1, tileMask = (1u << tileBits) - 1;
+	for(int x = 0; x < size; ++x) {
+		const uint32_t tile = x >> tileBits;
+		const uint32_t index = (spreadBits(tile & mask) << shift) | ((tile >> common) << (2 * common));
+		table[x] = (index << (2 * tileBits)) | (spreadBits(x & tileMask) << shift);
+	}
+	return table;
+}
+
+}
+
+NoiseTexture::NoiseTexture(Scalar scale, Arena &arena, bool baked): tile(nullptr), scale(scale) {
+	Scalar *g[3];
+	for(uint c = 0; c < 3; ++c) gradients[c] = g[c] = arena.alloc<Scalar>(nbVals);
+	for(int i = 0; i < nbVals; ++i) {
+		const Vec3 v = Vec3::randomSphere();
+		for(uint c = 0; c < 3; ++c) g[c][i] = v[c];
+	}
 	for(int i = 0; i < 2; ++i) {
-		perms[i] = new int[nbVals];
-		for(int j = 0; j < nbVals; ++j) perms[i][j] = j;
-		std::random_shuffle(perms[i], perms[i] + nbVals);
-	}
-}
-
-Color NoiseTexture::value(const Hittable *, const Vec3 &p, const Vec3 &) const {
-	const int depth = 6;
-	Scalar gray = 0., fr = scale, weight = 1.;
-	for(int d = 0; d < depth; ++d) {
-		Scalar u = fr * p.x, v = fr * p.y, w = fr * p.z;
-		int i = static_cast<int>(std::floor(u));
-		int j = static_cast<int>(std::floor(v));
-		int k = static_cast<int>(std::floor(w));
-		u -= i;
-		v -= j;
-		w -= k;
-		u *= u * (3. - 2*u);
-		v *= v * (3. - 2*v);
-		w *= w * (3. - 2*w);
-		Scalar w2 = 1. - w;
-		int i2 = (i+1) & (nbVals-1);
-		int j2 = perms[0][(j+1) & (nbVals-1)];
-		int k2 = perms[1][(k+1) & (nbVals-1)];
-		i &= (nbVals-1);
-		j = perms[0][j & (nbVals-1)];
-		k = perms[1][k & (nbVals-1)];
-		const auto fun = [&](int i, Scalar x, Scalar y, Scalar z) { return vecs[i].x*x + vecs[i].y*y + vecs[i].z*z; };
-		Scalar add = (1. - u) * ((1. - v) * (w2 * fun(i ^ j ^ k, u, v, w) + w * fun(i ^ j ^ k2, u, v, w-1.))
-						+ v * (w2 * fun(i ^ j2 ^ k, u, v-1., w) + w * fun(i ^ j2 ^ k2, u, v-1., w-1.)))
-					+ u * ((1. - v) * (w2 * fun(i2 ^ j ^ k, u-1., v, w) + w * fun(i2 ^ j ^ k2, u-1., v, w-1.))
-						+ v * (w2 * fun(i2 ^ j2 ^ k, u-1., v-1., w) + w * fun(i2 ^ j2 ^ k2, u-1., v-1., w-1.)));
-		gray += weight * add;
-		fr *= 2.;
-		weight *=.5;
+		int *p = arena.alloc<int>(nbVals);
+		for(int j = 0; j < nbVals; ++j) p[j] = j;
+		std::shuffle(p, p + nbVals, RandomBits());
+		perms[i] = p;
+	}
+	if(!baked) return;
+
+	float *t = static_cast<float*>(arena.allocate(sizeof(float) * BakedSize * BakedSize * BakedSize, 64));
+	const Scalar one = 1.;
+	parallelFor(BakedSize, [&](uint, size_t begin, size_t end) {
+		for(int k = begin; k < (int) end; ++k)
+			for(int j = 0; j < BakedSize; ++j)
+				for(int i = 0; i < BakedSize; ++i)
+					t[bakedIndex(i, j, k)] = gradientNoise(Vec3(i, j, k) / Scalar(BakedSamples), &one, 1, BakedCells - 1);
+	});
+	tile = t;
+}
+
+Scalar NoiseTexture::gradientNoise(const Vec3 &p, const Scalar *weights, uint nbOctaves, int mask) const {
+	// Lanes are the octaves, so that the arithmetic runs on vectors once the gradients are gathered
+	Scalar s[3][NbOctaves];
+	int cells[2][3][NbOctaves];
+	for(uint c = 0; c < 3; ++c) {
+		Scalar fr = 1.;
+		for(uint d = 0; d < nbOctaves; ++d, fr *= 2.) {
+			const Scalar x = fr * p[c];
+			const int fl = floorInt(x);
+			const Scalar f = x - fl;
+			s[c][d] = f * f * (3. - 2.*f);
+			cells[0][c][d] = fl & mask;
+			cells[1][c][d] = (fl + 1) & mask;
+		}
+	}
+	Scalar gx[8][NbOctaves], gy[8][NbOctaves], gz[8][NbOctaves];
+	for(uint d = 0; d < nbOctaves; ++d)
+		for(uint c = 0; c < 8; ++c) {
+			const int id = cells[c>>2][0][d] ^ perms[0][cells[(c>>1)&1][1][d]] ^ perms[1][cells[c&1][2][d]];
+			gx[c][d] = gradients[0][id];
+			gy[c][d] = gradients[1][id];
+			gz[c][d] = gradients[2][id];
+		}
+	// The offsets to the corners are taken from the smoothed coordinates
+	Scalar sum = 0.;
+	for(uint d = 0; d < nbOctaves; ++d) {
+		const Scalar x = s[0][d], y = s[1][d], z = s[2][d];
+		const auto dot = [&](uint c, Scalar dx, Scalar dy, Scalar dz) { return gx[c][d]*dx + gy[c][d]*dy + gz[c][d]*dz; };
+		sum += weights[d] * ((1. - x) * ((1. - y) * ((1. - z) * dot(0, x, y, z) + z * dot(1, x, y, z-1.))
+										+ y * ((1. - z) * dot(2, x, y-1., z) + z * dot(3, x, y-1., z-1.)))
+							+ x * ((1. - y) * ((1. - z) * dot(4, x-1., y, z) + z * dot(5, x-1., y, z-1.))
+										+ y * ((1. - z) * dot(6, x-1., y-1., z) + z * dot(7, x-1., y-1., z-1.))));
 	}
+	return sum;
+}
+
+Scalar NoiseTexture::bakedNoise(const Vec3 &p) const {
+	int i[2][3];
+	Scalar f[3];
+	for(uint c = 0; c < 3; ++c) {
+		const Scalar x = BakedSamples * p[c];
+		const int fl = floorInt(x);
+		f[c] = x - fl;
+		i[0][c] = fl & (BakedSize - 1);
+		i[1][c] = (fl + 1) & (BakedSize - 1);
+	}
+	Scalar sum = 0.;
+	for(uint c = 0; c < 8; ++c) {
+		const Scalar weight = ((c>>2) ? f[0] : 1. - f[0]) * (((c>>1)&1) ? f[1] : 1. - f[1]) * ((c&1) ? f[2] : 1. - f[2]);
+		sum += weight * tile[bakedIndex(i[c>>2][0], i[(c>>1)&1][1], i[c&1][2])];
+	}
+	return sum;
+}
+
+Color NoiseTexture::value(const Vec3 &p, Scalar footprint) const {
+	// Octave d has a wavelength of 1 / (scale 2^d), the last one kept fading out
+	const Scalar octaves = footprint > 0. ? std::clamp(std::log2(1. / (scale * footprint)), Scalar(1.), Scalar(NbOctaves)) : NbOctaves;
+	Scalar weights[NbOctaves];
+	uint nb = 0;
+	for(; nb < octaves; ++nb) weights[nb] = std::min(Scalar(1.), octaves - nb) / Scalar(1 << nb);
+	Scalar gray = 0.;
+	if(tile) {
+		Scalar fr = scale;
+		for(uint d = 0; d < nb; ++d, fr *= 2.) gray += weights[d] * bakedNoise(fr * p);
+	} else gray = gradientNoise(scale * p, weights, nb, nbVals - 1);
 	return Vec3(1., 1., 1.) * .5 * (1. + std::sin(scale * p.z + 8.*gray));
 }
 
-ImageTexture::ImageTexture(std::string fileName) {
-	data = stbi_load(fileName.c_str(), &W, &H, &C, 3);
-	if(!data) {
-		W = H = 0;
+ImageTexture::ImageTexture(std::string fileName, Arena &arena, TextureCache *cache, bool compress):
+	cache(cache),
+	compressed(compress),
+	quality(std::numeric_limits<Scalar>::infinity()) {
+	// Paged textures only decode the image when their tile file is missing or stale
+	const uint64_t key = cache ? MappedFile(fileName).hash() : 0;
+	if(cache && loadTileFile(fileName, key, arena)) return;
+	std::vector<std::vector<u_char>> tiled;
+	build(fileName, arena, tiled);
+	if(compressed) this->compress(tiled);
+	storedSize = 0;
+	for(const std::vector<u_char> &level : tiled) storedSize += level.size();
+	if(cache) {
+		TileFileHeader header {};
+		std::memcpy(header.magic, TileFileMagic, 8);
+		header.version = TileFileVersion;
+		header.channels = C;
+		header.nbLevels = nbLevels;
+		header.compressed = compressed;
+		header.key = key;
+		header.psnr = quality;
+		std::copy(widths, widths + nbLevels, header.widths);
+		std::copy(heights, heights + nbLevels, header.heights);
+		writeTileFile(fileName, header, tiled);
+		if(loadTileFile(fileName, key, arena)) return;
+		this->cache = nullptr; // the tile file cannot be written next to the image
+	}
+	for(uint l = 0; l < nbLevels; ++l) {
+		u_char *level = static_cast<u_char*>(arena.allocate(tiled[l].size(), 64));
+		std::copy(tiled[l].begin(), tiled[l].end(), level);
+		levels[l] = level;
+	}
+}
+
+size_t ImageTexture::setLevel(uint level, int width, int height, Arena &arena) {
+	widths[level] = width;
+	heights[level] = height;
+	uint bitsX = 0, bitsY = 0;
+	while(int(TileSize << bitsX) < width) ++ bitsX;
+	while(int(TileSize << bitsY) < height) ++ bitsY;
+	columnBits[level] = mortonBits(width, TileBits, bitsX, bitsY, 0, arena);
+	rowBits[level] = mortonBits(height, TileBits, bitsY, bitsX, 1, arena);
+	return offset(uint32_t(TileSize * TileSize) << (bitsX + bitsY));
+}
+
+void ImageTexture::build(const std::string &fileName, Arena &arena, std::vector<std::vector<u_char>> &tiled) {
+	int W, H;
+	u_char *pixels = stbi_load(fileName.c_str(), &W, &H, &C, 3);
+	if(!pixels) {
+		nbLevels = 0;
 		throw std::runtime_error("Failed to load the file " + fileName + "!!!");
 	}
+	C = 3;
+	std::vector<u_char> image(pixels, pixels + W * H * C), next;
+	stbi_image_free(pixels);
+
+	// Levels are built uncompressed, the padding repeating the last row and column
+	const bool compress = compressed;
+	compressed = false;
+	for(nbLevels = 0; nbLevels < MaxLevels; ++nbLevels) {
+		const int w = W, h = H;
+		const size_t size = setLevel(nbLevels, w, h, arena);
+		std::vector<u_char> &level = tiled.emplace_back(size);
+		int paddedW = TileSize, paddedH = TileSize;
+		while(paddedW < w) paddedW *= 2;
+		while(paddedH < h) paddedH *= 2;
+		for(int j = 0; j < paddedH; ++j)
+			for(int i = 0; i < paddedW; ++i)
+				std::copy_n(&image[C * (std::min(i, w-1) + w * std::min(j, h-1))], C, &level[C * index(nbLevels, i, j)]);
+		if(w == 1 && h == 1) break;
+
+		// The next level averages 2x2 texels, the last row or column being dropped for odd sizes
+		W = std::max(1, w / 2);
+		H = std::max(1, h / 2);
+		next.resize(W * H * C);
+		for(int j = 0; j < H; ++j)
+			for(int i = 0; i < W; ++i) {
+				const int i0 = std::min(2*i, w-1), i1 = std::min(2*i+1, w-1), j0 = std::min(2*j, h-1), j1 = std::min(2*j+1, h-1);
+				for(int c = 0; c < C; ++c)
+					next[C * (i + W * j) + c] = (image[C * (i0 + w * j0) + c] + image[C * (i1 + w * j0) + c]
+												+ image[C * (i0 + w * j1) + c] + image[C * (i1 + w * j1) + c] + 2) / 4;
+			}
+		image.swap(next);
+	}
+	nbLevels = std::min(nbLevels + 1, MaxLevels);
+	compressed = compress;
+}
+
+void ImageTexture::compress(std::vector<std::vector<u_char>> &tiled) {
+	std::vector<u_char> level0;
+	for(uint l = 0; l < nbLevels; ++l) {
+		std::vector<u_char> &texels = tiled[l];
+		std::vector<u_char> blocks(texels.size() / (C * 16) * BlockSize);
+		parallelFor(blocks.size() / BlockSize, [&](uint, size_t begin, size_t end) {
+			Color colors[16];
+			for(size_t b = begin; b < end; ++b) {
+				for(uint k = 0; k < 16; ++k) {
+					const u_char *p = &texels[C * (16*b + k)];
+					colors[k] = Color(p[0], p[1], p[2]);
+				}
+				encodeBlock(colors, &blocks[BlockSize * b]);
+			}
+		});
+		if(l == 0) level0.swap(texels);
+		texels.swap(blocks);
+	}
+
+	Scalar error = 0.;
+	for(int j = 0; j < heights[0]; ++j)
+		for(int i = 0; i < widths[0]; ++i) {
+			const uint32_t id = index(0, i, j);
+			const Color c = decodeBlock(&tiled[0][offset(id)], id & 15);
+			const u_char *p = &level0[C * id];
+			error += (c - Color(p[0], p[1], p[2])).norm2();
+		}
+	error /= Scalar(C) * widths[0] * heights[0];
+	quality = error > 0. ? 10. * std::log10(255. * 255. / error) : std::numeric_limits<Scalar>::infinity();
+}
+
+// End points along the principal axis of the colors, then refitted by least squares to the chosen selectors
+void ImageTexture::encodeBlock(const Color *texels, u_char *block) {
+	Color mean(0., 0., 0.);
+	for(uint k = 0; k < 16; ++k) mean += texels[k];
+	mean /= 16.;
+	Scalar cov[6] = {};
+	for(uint k = 0; k < 16; ++k) {
+		const Color d = texels[k] - mean;
+		cov[0] += d.x*d.x; cov[1] += d.x*d.y; cov[2] += d.x*d.z;
+		cov[3] += d.y*d.y; cov[4] += d.y*d.z; cov[5] += d.z*d.z;
+	}
+	Vec3 axis(1., 1., 1.);
+	for(uint it = 0; it < 8; ++it) {
+		axis = Vec3(cov[0]*axis.x + cov[1]*axis.y + cov[2]*axis.z, cov[1]*axis.x + cov[3]*axis.y + cov[4]*axis.z, cov[2]*axis.x + cov[4]*axis.y + cov[5]*axis.z);
+		const Scalar n = axis.norm();
+		if(n < 1e-9) break;
+		axis /= n;
+	}
+	Scalar lo = 0., hi = 0.;
+	for(uint k = 0; k < 16; ++k) {
+		const Scalar p = dot(texels[k] - mean, axis);
+		lo = std::min(lo, p);
+		hi = std::max(hi, p);
+	}
+
+	static constexpr Scalar weights[4] = { 0., 1., 1./3., 2./3. };
+	uint16_t bestEnds[2];
+	uint32_t bestSelectors = 0;
+	Scalar bestError = std::numeric_limits<Scalar>::max();
+	Color a = mean + lo * axis, b = mean + hi * axis;
+	for(uint fit = 0; fit < 2; ++fit) {
+		const uint16_t ends[2] = { pack565(a), pack565(b) };
+		const Color ea = expand565(ends[0]), eb = expand565(ends[1]);
+		uint32_t selectors = 0;
+		Scalar error = 0.;
+		for(uint k = 0; k < 16; ++k) {
+			uint best = 0;
+			Scalar bestDist = std::numeric_limits<Scalar>::max();
+			for(uint s = 0; s < 4; ++s) {
+				const Scalar dist = (ea + weights[s] * (eb - ea) - texels[k]).norm2();
+				if(dist < bestDist) {
+					bestDist = dist;
+					best = s;
+				}
+			}
+			selectors |= best << (2*k);
+			error += bestDist;
+		}
+		if(error < bestError) {
+			bestError = error;
+			bestEnds[0] = ends[0];
+			bestEnds[1] = ends[1];
+			bestSelectors = selectors;
+		}
+
+		// Least squares end points for these selectors
+		Scalar aa = 0., ab = 0., bb = 0.;
+		Color ax(0., 0., 0.), bx(0., 0., 0.);
+		for(uint k = 0; k < 16; ++k) {
+			const Scalar w = weights[(selectors >> (2*k)) & 3];
+			aa += (1. - w) * (1. - w);
+			ab += (1. - w) * w;
+			bb += w * w;
+			ax += (1. - w) * texels[k];
+			bx += w * texels[k];
+		}
+		const Scalar det = aa * bb - ab * ab;
+		if(std::abs(det) < 1e-9) break;
+		a = (bb * ax - ab * bx) / det;
+		b = (aa * bx - ab * ax) / det;
+	}
+	std::memcpy(block, bestEnds, 4);
+	std::memcpy(block + 4, &bestSelectors, 4);
+}
+
+bool ImageTexture::loadTileFile(const std::string &fileName, uint64_t key, Arena &arena) {
+	std::ifstream ifs(tileName(fileName), std::ios::binary);
+	TileFileHeader header;
+	if(!ifs.read((char*) &header, sizeof(header))) return false;
+	if(std::memcmp(header.magic, TileFileMagic, 8) != 0 || header.version != TileFileVersion || header.key != key
+		|| header.compressed != compressed || header.nbLevels == 0 || header.nbLevels > MaxLevels) return false;
+	C = header.channels;
+	nbLevels = header.nbLevels;
+	quality = header.psnr;
+	const size_t pageSize = offset(1u << PageBits);
+	std::vector<PageEntry> pages;
+	uint64_t fileOffset = sizeof(header);
+	for(uint l = 0; l < nbLevels; ++l) {
+		const size_t size = setLevel(l, header.widths[l], header.heights[l], arena);
+		firstPage[l] = pages.size();
+		for(size_t p = 0; p < size; p += pageSize) pages.push_back({ fileOffset + p, (uint32_t) std::min(pageSize, size - p) });
+		fileOffset += size;
+	}
+	storedSize = fileOffset - sizeof(header);
+	ifs.seekg(0, std::ios::end);
+	if(!ifs || (uint64_t) ifs.tellg() < fileOffset) return false;
+	const uint first = cache->addFile(tileName(fileName), pages);
+	for(uint l = 0; l < nbLevels; ++l) firstPage[l] += first;
+	return true;
 }
-#include <iostream>
-Color ImageTexture::value(const Hittable *hittable, const Vec3 &p, const Vec3 &normal) const {
-	Vec2 uv = hittable->getUV(p, normal);
-	int i = std::min(int(uv.x * W), W-1), j = std::min(int((1. - uv.y) * H), H-1);
-	u_char* pix = data + C * (i + W * j);
-	const Scalar mult = 1. / 255.;
-	return Color(mult * pix[0], mult * pix[1], mult * pix[2]);
+
+Color ImageTexture::bilinear(uint level, const Vec2 &uv) const {
+	const int W = widths[level], H = heights[level];
+	const Scalar x = uv.x * W - .5, y = (1. - uv.y) * H - .5;
+	const Scalar fx = std::floor(x), fy = std::floor(y);
+	const Scalar dx = x - fx, dy = y - fy;
+	// Wrapped around horizontally, where the u=0 and u=1 edges of the spherical maps meet, clamped vertically at the poles
+	const int i0 = (int(fx) % W + W) % W, i1 = (i0 + 1) % W;
+	const int j0 = std::clamp(int(fy), 0, H-1), j1 = std::clamp(int(fy) + 1, 0, H-1);
+	return (1. / 255.) * ((1. - dy) * ((1. - dx) * texel(level, i0, j0) + dx * texel(level, i1, j0))
+						+ dy * ((1. - dx) * texel(level, i0, j1) + dx * texel(level, i1, j1)));
+}
+
+Color ImageTexture::value(const Vec2 &uv, Scalar footprint) const {
+	const Scalar lod = std::clamp(std::log2(std::max(footprint, 1.)), 0., Scalar(nbLevels - 1));
+	const uint level = lod;
+	if(level + 1 >= nbLevels) return bilinear(level, uv);
+	const Scalar f = lod - level;
+	return (1. - f) * bilinear(level, uv) + f * bilinear(level+1, uv);
 }
\ No newline at end of file
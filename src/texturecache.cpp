@@ -0,0 +1,19 @@
+#include "texturecache.h"
+
+thread_local std::array<TextureCache::MicroEntry, TextureCache::MicroCacheSize> TextureCache::micro;
+
+size_t readTexturePage(int fd, const PageEntry &entry, std::vector<u_char> &page) {
+	page.resize(entry.size);
+	size_t done = 0;
+	while(done < entry.size) {
+		const ssize_t n = pread(fd, page.data() + done, entry.size - done, entry.offset + done);
+		if(n <= 0) throw std::runtime_error("Cannot read texture page!");
+		done += n;
+	}
+	return entry.size;
+}
+
+TextureCache::TextureCache(size_t budget): cache(budget) {
+	static std::atomic<uint64_t> serials = {0};
+	serial = ++ serials;
+}
\ No newline at end of file